@@ -0,0 +1,419 @@
+// Matcher benchmarks and pathological-pattern regression checks.
+//
+//   cmake --build build --target bench
+//
+// builds this driver and runs it. All corpora are generated from fixed seeds,
+// so numbers from two commits are comparable; results are printed as a table
+// and written to bench.json.
+//
+//   grep-bench [--reps N] [--scale X] [--filter SUBSTR] [--json FILE] [--corpus DIR]
+//
+// Exits with 1 if a pathological case is slower than its time cap.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "grepcore.hpp"
+#include "options.hpp"
+#include "search.hpp"
+
+namespace fs = std::filesystem;
+
+// ---- allocation counting ---------------------------------------------------
+
+static std::atomic<uint64_t> g_allocs{0};
+
+void* operator new(std::size_t n){
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// ---- deterministic corpora -------------------------------------------------
+
+// xorshift64*: same sequence on every platform, unlike <random> distributions
+struct Rng {
+    uint64_t s;
+    uint64_t next(){
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        return s * 0x2545F4914F6CDD1DULL;
+    }
+    size_t below(size_t n){ return static_cast<size_t>(next() % n); }
+    template <typename T, size_t N>
+    const T& pick(const T (&a)[N]){ return a[below(N)]; }
+};
+
+static const char* kLevels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+static const char* kMethods[] = {"GET", "GET", "GET", "POST", "PUT", "DELETE"};
+static const char* kPaths[] = {"/api/v1/users", "/api/v1/orders", "/static/app.js", "/health",
+                               "/api/v2/search", "/login", "/api/v1/items"};
+static const char* kWords[] = {"alpha", "beta", "gamma", "delta", "request", "buffer", "thread",
+                               "match", "value", "result", "index", "offset", "config", "user_id"};
+
+static std::string hex_id(Rng& r){
+    char buf[17];
+    std::snprintf(buf, sizeof buf, "%016llx", static_cast<unsigned long long>(r.next()));
+    return buf;
+}
+
+static std::string make_log(size_t bytes){
+    Rng r{0x5eed1};
+    std::string out;
+    out.reserve(bytes + 256);
+    char line[320];
+    while (out.size() < bytes){
+        int n = std::snprintf(line, sizeof line,
+            "2024-01-%02zuT%02zu:%02zu:%02zu.%03zuZ %s [worker-%zu] %s %s/%zu status=%zu latency=%zums id=%s user_%s=%zu\n",
+            1 + r.below(28), r.below(24), r.below(60), r.below(60), r.below(1000),
+            r.pick(kLevels), r.below(64), r.pick(kMethods), r.pick(kPaths), r.below(100000),
+            r.below(20) ? 200 + r.below(5) : 500 + r.below(4), r.below(2000),
+            hex_id(r).c_str(), r.pick(kWords), r.below(1000));
+        out.append(line, n);
+    }
+    return out;
+}
+
+// a handful of multi-megabyte lines, one of them holding the needle
+static std::string make_long_lines(size_t bytes){
+    Rng r{0x5eed2};
+    std::string out;
+    const size_t lines = 8, per_line = bytes / lines;
+    for (size_t k = 0; k < lines; ++k){
+        size_t start = out.size();
+        while (out.size() - start < per_line){
+            out += r.pick(kWords);
+            out += r.below(8) ? ' ' : ',';
+            if (k == 5 && out.size() - start > per_line / 2 && out.find("NEEDLE", start) == std::string::npos){
+                out += "NEEDLE 1234x5678 ";
+            }
+        }
+        out += '\n';
+    }
+    return out;
+}
+
+// Runs of a's followed by a byte that breaks the match, then the byte the
+// pattern ends with: any prefilter lets every line through, and a naive
+// backtracker tries exponentially many ways to split the run.
+static std::string make_pathological(size_t lines){
+    Rng r{0x5eed3};
+    std::string out;
+    for (size_t k = 0; k < lines; ++k){
+        out.append(20 + r.below(12), 'a');
+        out += k % 97 == 0 ? "b\n" : "!bc\n";
+    }
+    return out;
+}
+
+// One long line of a's: a counted repeat stays in flight across all of it,
+// with one live count per byte up to its bound. Its size doesn't follow
+// --scale, since the cost depends on the count, not the line.
+static std::string make_run(){
+    return std::string(200'000, 'a') + '\n';
+}
+
+// a source-like tree, written once and reused while its marker file says it
+// holds the same number of files
+static void make_tree(const fs::path& dir, size_t files){
+    fs::path marker = dir / ".complete";
+    size_t have = 0;
+    if (std::ifstream(marker) >> have && have == files) return;
+    fs::remove_all(dir);
+    Rng r{0x5eed4};
+    static const char* kDirs[] = {"src", "src/core", "src/net", "lib", "lib/util", "include", "tests"};
+    for (const char* d : kDirs) fs::create_directories(dir / d);
+    for (size_t f = 0; f < files; ++f){
+        std::ofstream out(dir / r.pick(kDirs) / ("file" + std::to_string(f) + ".cpp"));
+        size_t lines = 50 + r.below(300);
+        for (size_t l = 0; l < lines; ++l){
+            switch (r.below(6)){
+                case 0: out << "#include \"" << r.pick(kWords) << ".hpp\"\n"; break;
+                case 1: out << "static int " << r.pick(kWords) << "_" << r.below(100) << "(int "
+                            << r.pick(kWords) << "){\n"; break;
+                case 2: out << "    // " << (r.below(40) ? "" : "TODO: ") << r.pick(kWords) << " "
+                            << r.pick(kWords) << "\n"; break;
+                case 3: out << "    return " << r.pick(kWords) << " + " << r.below(1000) << ";\n"; break;
+                default: out << "    " << r.pick(kWords) << "[" << r.below(64) << "] = "
+                             << r.pick(kWords) << ";\n"; break;
+            }
+        }
+    }
+    std::ofstream(marker) << files << "\n";
+}
+
+// ---- measurement -----------------------------------------------------------
+
+struct Case {
+    std::string name;
+    std::string corpus;               // "log", "long", "patho", "run" or "tree"
+    std::vector<std::string> patterns;
+    bool fixed = false;
+    unsigned jobs = 1;                // tree only
+    double cap_ms = 0;                // regression cap on p99, 0 = none
+    uint64_t budget = 0;              // backtracking step budget, 0 = default
+    bool ignore_case = false;         // -i
+};
+
+struct Result {
+    Case c;
+    size_t bytes = 0, lines = 0;
+    uint64_t matches = 0;
+    uint64_t gave_up = 0;             // lines the backtracker ran out of budget on
+    std::vector<double> ms;           // one per repetition, sorted
+    double allocs_per_match = 0;
+    bool ok = true;
+
+    double pct(double p) const {
+        size_t k = static_cast<size_t>(p * (ms.size() - 1) + 0.5);
+        return ms[std::min(k, ms.size() - 1)];
+    }
+    double mb_per_s() const { return bytes / 1e6 / (pct(0.5) / 1e3); }
+    double lines_per_s() const { return lines / (pct(0.5) / 1e3); }
+};
+
+// swallows what Searcher writes to std::cout
+struct NullBuf : std::streambuf {
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static uint64_t count_matches(const grepcore::Matcher& m, std::string_view buf,
+                              grepcore::ScanStats& stats){
+    uint64_t n = 0;
+    size_t pos = 0, hit;
+    grepcore::Scanner scanner(m, buf);
+    while ((hit = scanner.next(pos, &stats)) != std::string_view::npos){
+        ++n;
+        const void* nl = std::memchr(buf.data() + hit, '\n', buf.size() - hit);
+        pos = nl ? static_cast<const char*>(nl) - buf.data() + 1 : buf.size() + 1;
+    }
+    return n;
+}
+
+static Result run_buffer(const Case& c, const std::string& corpus, int reps){
+    Result res;
+    res.c = c;
+    res.bytes = corpus.size();
+    res.lines = std::count(corpus.begin(), corpus.end(), '\n');
+    grepcore::CompileOptions copts;
+    copts.fixed_strings = c.fixed;
+    copts.ignore_case = c.ignore_case;
+    if (c.budget) copts.step_budget = c.budget;
+    grepcore::Matcher pats(c.patterns, copts);
+    grepcore::ScanStats stats;
+    count_matches(pats, corpus, stats); // warm up caches (DFA states, scratch)
+    uint64_t allocs = 0;
+    for (int k = 0; k < reps; ++k){
+        stats = {};
+        uint64_t a0 = g_allocs.load();
+        auto t0 = std::chrono::steady_clock::now();
+        res.matches = count_matches(pats, corpus, stats);
+        auto t1 = std::chrono::steady_clock::now();
+        allocs += g_allocs.load() - a0;
+        res.ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    res.gave_up = stats.gave_up;
+    res.allocs_per_match = res.matches ? double(allocs) / reps / res.matches : double(allocs) / reps;
+    return res;
+}
+
+static Result run_tree(const Case& c, const fs::path& dir, int reps){
+    Result res;
+    res.c = c;
+    for (auto& e : fs::recursive_directory_iterator(dir)){
+        if (!e.is_regular_file()) continue;
+        res.bytes += e.file_size();
+        std::ifstream in(e.path());
+        res.lines += std::count(std::istreambuf_iterator<char>(in), {}, '\n');
+    }
+    Options opt;
+    opt.patterns = c.patterns;
+    opt.fixed_strings = c.fixed;
+    opt.ignore_case = c.ignore_case;
+    opt.recursive = true;
+    opt.count = true;
+    opt.jobs = c.jobs;
+    grepcore::CompileOptions copts;
+    copts.fixed_strings = c.fixed;
+    copts.ignore_case = c.ignore_case;
+    grepcore::Matcher pats(opt.patterns, copts);
+
+    NullBuf null;
+    std::streambuf* saved = std::cout.rdbuf(&null);
+    uint64_t allocs = 0;
+    for (int k = 0; k < reps; ++k){
+        Output out;
+        Searcher searcher(pats, opt, out);
+        uint64_t a0 = g_allocs.load();
+        auto t0 = std::chrono::steady_clock::now();
+        searcher.search_tree({dir.string()});
+        auto t1 = std::chrono::steady_clock::now();
+        allocs += g_allocs.load() - a0;
+        res.ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    std::cout.rdbuf(saved);
+
+    Output out;
+    opt.count = false;
+    opt.jobs = 1;
+    Searcher counter(pats, opt, out);
+    std::ostringstream lines;
+    saved = std::cout.rdbuf(lines.rdbuf());
+    counter.search_tree({dir.string()});
+    std::cout.rdbuf(saved);
+    std::string text = lines.str();
+    res.matches = std::count(text.begin(), text.end(), '\n');
+    res.allocs_per_match = res.matches ? double(allocs) / reps / res.matches : double(allocs) / reps;
+    return res;
+}
+
+// ---- reporting -------------------------------------------------------------
+
+static std::string json_escape(const std::string& s){
+    std::string out;
+    for (char c : s){
+        if (c == '"' || c == '\\'){ out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20){
+            char buf[8];
+            std::snprintf(buf, sizeof buf, "\\u%04x", c);
+            out += buf;
+        }
+        else out += c;
+    }
+    return out;
+}
+
+static void write_json(const std::string& path, const std::vector<Result>& results, double scale, int reps){
+    std::ofstream out(path);
+    out << "{\n  \"scale\": " << scale << ",\n  \"reps\": " << reps << ",\n  \"cases\": [\n";
+    for (size_t k = 0; k < results.size(); ++k){
+        const Result& r = results[k];
+        out << "    {\"name\": \"" << json_escape(r.c.name) << "\", \"corpus\": \"" << r.c.corpus
+            << "\", \"patterns\": " << r.c.patterns.size()
+            << ", \"bytes\": " << r.bytes << ", \"lines\": " << r.lines
+            << ", \"matches\": " << r.matches << ", \"gave_up\": " << r.gave_up
+            << ", \"mb_per_s\": " << r.mb_per_s() << ", \"lines_per_s\": " << r.lines_per_s()
+            << ", \"p50_ms\": " << r.pct(0.5) << ", \"p90_ms\": " << r.pct(0.9)
+            << ", \"p99_ms\": " << r.pct(0.99) << ", \"max_ms\": " << r.ms.back()
+            << ", \"allocs_per_match\": " << r.allocs_per_match
+            << ", \"cap_ms\": " << r.c.cap_ms << ", \"ok\": " << (r.ok ? "true" : "false") << "}"
+            << (k + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+static std::vector<Case> make_cases(unsigned threads){
+    std::vector<std::string> ids, regexes;
+    Rng r{0x5eed5};
+    for (int k = 0; k < 1000; ++k) ids.push_back(hex_id(r).substr(0, 10));
+    for (int k = 0; k < 100; ++k){
+        regexes.push_back(std::string(r.pick(kWords)) + "=" + std::to_string(r.below(1000)) + "$");
+    }
+    std::vector<Case> cases = {
+        {"literal", "log", {"ERROR"}},
+        {"literal-icase", "log", {"error"}, false, 1, 0, 0, true},
+        {"rare-literal", "log", {"id=ffff"}},
+        {"class", "log", {"status=5\\d\\d"}},
+        {"alternation", "log", {"PUT|DELETE"}},
+        {"anchored", "log", {"^2024-01-0[1-3]T"}},
+        {"word-run", "log", {"user_\\w+=99\\d"}},
+        {"backref", "log", {"(\\d\\d):\\1:\\1"}},
+        {"counted", "log", {"latency=\\d{1,3}ms id=[0-9a-f]{16}"}},
+        {"counted-backref", "log", {"T(\\d{2}):\\d{2}:\\1\\.\\d{1,3}Z"}},
+        {"multi-literal-1000", "log", ids, true},
+        {"multi-literal-icase", "log", ids, true, 1, 0, 0, true},
+        {"multi-regex-100", "log", regexes},
+        {"long-literal", "long", {"NEEDLE"}},
+        {"long-class", "long", {"\\d+x\\d+"}},
+        {"patho-nested-plus", "patho", {"(a+)+b"}, false, 1, 500},
+        {"patho-alt-loop", "patho", {"(a|aa)+c"}, false, 1, 500},
+        {"patho-optional", "patho", {"(a?)+a+c"}, false, 1, 500},
+        // DFA states as large as the count; the cache is bounded by their size
+        {"patho-counted", "run", {"a.{10000}[bc]"}, false, 1, 4000},
+        // every line exhausts its budget here; the cap bounds the cost of that
+        {"patho-backref", "patho", {"(a+)+\\1c"}, false, 1, 5000, 100'000},
+        {"patho-backref-alt", "patho", {"((a|aa)+)\\1c"}, false, 1, 5000, 100'000},
+        // the loop after the backref runs on the visited-state memo
+        {"patho-backref-tail", "patho", {"(a)\\1(a|aa)+c"}, false, 1, 500, 100'000},
+        {"tree-literal-j1", "tree", {"TODO"}, false, 1},
+        {"tree-literal-jN", "tree", {"TODO"}, false, threads},
+        {"tree-regex-jN", "tree", {"return \\w+ \\+ 99\\d"}, false, threads},
+    };
+    return cases;
+}
+
+int main(int argc, char* argv[]){
+    int reps = 9;
+    double scale = 1.0;
+    std::string filter, json = "bench.json", corpus_dir = "bench-corpus";
+    for (int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc){ std::cerr << arg << " needs a value\n"; std::exit(2); }
+            return argv[++i];
+        };
+        if (arg == "--reps") reps = std::max(1, std::stoi(value()));
+        else if (arg == "--scale") scale = std::stod(value());
+        else if (arg == "--filter") filter = value();
+        else if (arg == "--json") json = value();
+        else if (arg == "--corpus") corpus_dir = value();
+        else { std::cerr << "usage: grep-bench [--reps N] [--scale X] [--filter SUBSTR] [--json FILE] [--corpus DIR]\n"; return 2; }
+    }
+
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<Case> cases = make_cases(threads);
+    std::string log, long_lines, patho, run;
+    std::vector<Result> results;
+    bool all_ok = true;
+
+    std::printf("%-20s %10s %12s %9s %9s %9s %10s %8s %s\n",
+                "case", "MB/s", "lines/s", "p50 ms", "p90 ms", "p99 ms", "allocs/m", "gave up", "matches");
+    for (const Case& c : cases){
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+        Result res;
+        if (c.corpus == "tree"){
+            fs::path dir = fs::path(corpus_dir) / "tree";
+            make_tree(dir, static_cast<size_t>(1500 * scale));
+            res = run_tree(c, dir, reps);
+        } else {
+            std::string& buf = c.corpus == "log" ? log : c.corpus == "long" ? long_lines
+                             : c.corpus == "run" ? run : patho;
+            if (buf.empty()){
+                if (c.corpus == "log") buf = make_log(static_cast<size_t>(64e6 * scale));
+                else if (c.corpus == "long") buf = make_long_lines(static_cast<size_t>(32e6 * scale));
+                else if (c.corpus == "run") buf = make_run();
+                else buf = make_pathological(static_cast<size_t>(2000 * scale));
+            }
+            res = run_buffer(c, buf, reps);
+        }
+        std::sort(res.ms.begin(), res.ms.end());
+        double cap = c.corpus == "run" ? c.cap_ms : c.cap_ms * scale; // "run" isn't scaled
+        if (c.cap_ms > 0 && res.pct(0.99) > cap){ res.ok = false; all_ok = false; }
+        std::printf("%-20s %10.1f %12.0f %9.2f %9.2f %9.2f %10.3f %8llu %llu%s\n",
+                    c.name.c_str(), res.mb_per_s(), res.lines_per_s(), res.pct(0.5), res.pct(0.9),
+                    res.pct(0.99), res.allocs_per_match, static_cast<unsigned long long>(res.gave_up),
+                    static_cast<unsigned long long>(res.matches),
+                    res.ok ? "" : "  SLOWER THAN CAP");
+        std::fflush(stdout);
+        results.push_back(std::move(res));
+    }
+    write_json(json, results, scale, reps);
+    std::printf("wrote %s\n", json.c_str());
+    return all_ok ? 0 : 1;
+}
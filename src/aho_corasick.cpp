@@ -0,0 +1,125 @@
+#include "aho_corasick.hpp"
+
+#include <bitset>
+#include <stdexcept>
+
+static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& given, bool ignore_case){
+    // -i: the trie holds the needles folded, and an upper case letter is
+    // given the class of its lower case one
+    std::vector<std::string> folded;
+    if (ignore_case){
+        folded = given;
+        for (auto& nd : folded){
+            for (char& c : nd) c = static_cast<char>(fold_case(c));
+        }
+    }
+    const std::vector<std::string>& needles = ignore_case ? folded : given;
+
+    std::bitset<256> used, first;
+    for (const auto& nd : needles){
+        for (unsigned char c : nd) used.set(c);
+        first.set(static_cast<unsigned char>(nd[0]));
+    }
+    for (int c = 0; c < 256; ++c) class_of_[c] = used[c] ? static_cast<uint16_t>(nclasses_++) : 0;
+    if (ignore_case){
+        for (int c = 'A'; c <= 'Z'; ++c){
+            class_of_[c] = class_of_[c | 0x20];
+            first[c] = first[c | 0x20];
+        }
+    }
+    skip_ = ByteSet(~first);
+
+    // trie; states are numbered in creation order, 0 is the root
+    std::vector<uint32_t> go(nclasses_, kNone);
+    std::vector<bool> terminal(1, false);
+    depth_.assign(1, 0);
+    needle_at_.assign(1, kNone);
+    for (uint32_t k = 0; k < needles.size(); ++k){
+        uint32_t s = 0;
+        for (unsigned char c : needles[k]){
+            size_t edge = s * nclasses_ + class_of_[c];
+            if (go[edge] == kNone){
+                if (go.size() + nclasses_ >= kMatch) throw std::runtime_error("too many fixed strings");
+                go[edge] = static_cast<uint32_t>(terminal.size());
+                terminal.push_back(false);
+                depth_.push_back(depth_[s] + 1);
+                needle_at_.push_back(kNone);
+                go.resize(go.size() + nclasses_, kNone);
+            }
+            s = go[edge];
+        }
+        terminal[s] = true;
+        if (needle_at_[s] == kNone) needle_at_[s] = k;
+    }
+
+    // Breadth first, fill the missing edges from the failure state, which
+    // is shallower and therefore complete already. A state whose failure
+    // chain reaches a needle's end is a match state too.
+    size_t nstates = terminal.size();
+    std::vector<uint32_t> fail(nstates, 0), queue;
+    queue.reserve(nstates);
+    for (uint32_t c = 0; c < nclasses_; ++c){
+        uint32_t& t = go[c];
+        if (t == kNone) t = 0;
+        else queue.push_back(t);
+    }
+    for (size_t q = 0; q < queue.size(); ++q){
+        uint32_t s = queue[q];
+        for (uint32_t c = 0; c < nclasses_; ++c){
+            uint32_t& t = go[s * nclasses_ + c];
+            uint32_t via_fail = go[fail[s] * nclasses_ + c];
+            if (t == kNone){ t = via_fail; continue; }
+            fail[t] = via_fail;
+            if (terminal[via_fail]) terminal[t] = true;
+            queue.push_back(t);
+        }
+    }
+
+    delta_.resize(go.size());
+    for (size_t k = 0; k < go.size(); ++k){
+        delta_[k] = go[k] * nclasses_ | (terminal[go[k]] ? kMatch : 0);
+    }
+}
+
+size_t AhoCorasick::scan(std::string_view buf, size_t from) const {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(buf.data());
+    size_t n = buf.size();
+    uint32_t row = 0;
+    for (size_t i = from; i < n; ++i){
+        if (row == 0){
+            i = skip_.span(buf, i);
+            if (i == n) break;
+        }
+        uint32_t t = delta_[row + class_of_[p[i]]];
+        if (t & kMatch) return i;
+        row = t;
+    }
+    return std::string_view::npos;
+}
+
+// Walk the trie from each candidate start in turn. A transition that doesn't
+// go one level deeper followed a failure link: no needle starting at `b`
+// goes on from there.
+bool AhoCorasick::find(std::string_view line, size_t from, bool longest, grepcore::Span& out) const {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(line.data());
+    size_t n = line.size();
+    for (size_t b = skip_.span(line, from); b < n; b = skip_.span(line, b + 1)){
+        uint32_t row = 0, best = kNone;
+        size_t end = 0;
+        for (size_t i = b; i < n; ++i){
+            uint32_t next = delta_[row + class_of_[p[i]]] & ~kMatch;
+            uint32_t s = next / nclasses_;
+            if (depth_[s] != i - b + 1) break;
+            row = next;
+            uint32_t k = needle_at_[s];
+            if (k != kNone && (longest || k < best)){ best = k; end = i + 1; }
+        }
+        if (best != kNone){
+            out = {b, end};
+            return true;
+        }
+    }
+    return false;
+}
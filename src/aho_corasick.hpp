@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "byteset.hpp"
+#include "grepcore.hpp"
+
+// Aho-Corasick automaton for many literal strings at once, built up front as
+// a dense DFA over byte classes (bytes that occur in no needle share one
+// class). Every input byte is one table load, however many needles there
+// are; in the root state, bytes that start no needle are skipped with
+// ByteSet::span().
+class AhoCorasick {
+public:
+    // needles must be non-empty and must not contain '\n'; with
+    // `ignore_case` the two cases of a letter are one byte class
+    explicit AhoCorasick(const std::vector<std::string>& needles, bool ignore_case = false);
+
+    // Search a buffer of '\n'-separated lines from `from`, which starts a
+    // line. Returns the offset of the last byte of the first occurrence
+    // (so an offset inside the matching line) or npos.
+    size_t scan(std::string_view buf, size_t from) const;
+
+    // Leftmost occurrence in one line starting at or after `from`: the
+    // longest needle there, or with `longest` false the first given.
+    bool find(std::string_view line, size_t from, bool longest, grepcore::Span& out) const;
+
+    size_t state_count() const { return delta_.size() / nclasses_; }
+
+private:
+    static constexpr uint32_t kMatch = 0x80000000u; // set on edges into a match
+
+    uint32_t nclasses_ = 1;
+    uint16_t class_of_[256];
+    // delta_[row + class] = row of the next state, rows premultiplied by
+    // nclasses_, with kMatch or-ed in when that state ends a needle
+    std::vector<uint32_t> delta_;
+    ByteSet skip_;             // bytes no needle starts with
+    // per state, for find(): its depth in the trie, and the first needle
+    // ending exactly there (not via a failure link) or ~0u
+    std::vector<uint32_t> depth_;
+    std::vector<uint32_t> needle_at_;
+};
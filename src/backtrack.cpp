@@ -0,0 +1,231 @@
+#include "backtrack.hpp"
+#include "counters.hpp"
+
+#include <algorithm>
+#include <string_view>
+
+namespace {
+
+constexpr size_t kUnset = std::string_view::npos;
+
+// A choice point (resume at pc with the input at pos); with slot == kRun,
+// one for every pos from there to last, counting down for a greedy run and
+// up for a lazy one; with another slot, the old value of that slot to put
+// back when the stack unwinds past it.
+struct Job {
+    uint32_t pc;
+    uint32_t slot;
+    size_t pos;
+    size_t last = 0;
+};
+
+struct Scratch {
+    std::vector<Job> stack;
+    std::vector<size_t> slots;
+    std::vector<uint64_t> visited; // memo bits, (line length + 1) per memo pc
+};
+
+Scratch& scratch(){
+    thread_local Scratch s;
+    return s;
+}
+
+} // namespace
+
+Backtracker::Backtracker(const Prog& prog, uint64_t step_budget)
+    : prog_(prog), budget_(step_budget) {
+    nslots_ = 2 * static_cast<uint32_t>(prog_.ngroups);
+    loop_slot_.assign(prog_.insts.size(), kNoSlot);
+    for (uint32_t pc = 0; pc < prog_.insts.size(); ++pc){
+        const Inst& in = prog_.insts[pc];
+        if (in.op != Op::Split) continue;
+        uint32_t body = loop_start(in, pc);
+        if (body != kNoLoop && loop_slot_[body] == kNoSlot) loop_slot_[body] = nslots_++;
+    }
+
+    // Which instructions can reach a BackRef: walk the edges backwards
+    // until nothing changes (loops need more than one pass).
+    const size_t ninsts = prog_.insts.size();
+    std::vector<bool> reaches(ninsts, false);
+    for (bool changed = true; changed; ){
+        changed = false;
+        for (size_t pc = ninsts; pc-- > 0; ){
+            if (reaches[pc]) continue;
+            const Inst& in = prog_.insts[pc];
+            bool r = false;
+            switch (in.op){
+                case Op::BackRef: r = true; break;
+                case Op::Split:   r = reaches[in.x] || reaches[in.y]; break;
+                case Op::Jmp:     r = reaches[in.x]; break;
+                case Op::Match:
+                case Op::Fail:    break;
+                default:          r = pc + 1 < ninsts && reaches[pc + 1]; break;
+            }
+            if (r){ reaches[pc] = true; changed = true; }
+        }
+    }
+    memo_index_.assign(ninsts, kNoSlot);
+    for (uint32_t pc = 0; pc < ninsts; ++pc){
+        if (!reaches[pc]) memo_index_[pc] = nmemo_++;
+    }
+}
+
+Backtracker::Outcome Backtracker::match(std::string_view s) const {
+    return find(s, 0, false, nullptr);
+}
+
+Backtracker::Outcome Backtracker::find(std::string_view s, size_t from, bool longest,
+                                       grepcore::Span* out) const {
+    Scratch& m = scratch();
+    std::vector<Job>& stack = m.stack;
+    std::vector<size_t>& slots = m.slots;
+    slots.assign(nslots_, kUnset);
+
+    const uint64_t limit = budget_ ? budget_ : UINT64_MAX;
+    uint64_t steps = 0, starts = 0;
+    const size_t n = s.size();
+    // for --stats, counted once on the way out whatever the outcome
+    struct Tally {
+        const uint64_t& steps;
+        const uint64_t& starts;
+        ~Tally(){
+            counters::Block& c = counters::local();
+            counters::add(c.steps, steps);
+            counters::add(c.starts, starts);
+        }
+    } tally{steps, starts};
+
+    // Bit per (memo pc, pos) already visited. It is kept across start
+    // offsets: nothing reachable from there matched from the earlier ones
+    // either. Lines too long for it are backtracked without a memo.
+    const size_t row = n + 1;
+    const bool memo = nmemo_ && nmemo_ * row <= kMaxMemoBits;
+    if (memo) m.visited.assign((nmemo_ * row + 63) / 64, 0);
+
+    auto set_slot = [&](uint32_t slot, size_t pos){
+        stack.push_back({0, slot, slots[slot]});
+        slots[slot] = pos;
+    };
+
+    for (size_t start = from; start <= n; ++start){
+        // jump to the next offset a match can begin at
+        if (prog_.anchor == Anchor::Start && start > 0) break;
+        if (!prog_.nullable){
+            start = prog_.skip.span(s, start);
+            if (start == n) break;
+        }
+        ++starts;
+        bool found = false;
+        size_t longest_end = 0;
+        stack.clear();
+        stack.push_back({prog_.start, kNoSlot, start});
+
+        while (!stack.empty()){
+            Job job = stack.back();
+            stack.pop_back();
+            if (job.slot == kRun){
+                if (job.pos > job.last) stack.push_back({job.pc, kRun, job.pos - 1, job.last});
+                else if (job.pos < job.last) stack.push_back({job.pc, kRun, job.pos + 1, job.last});
+            } else if (job.slot != kNoSlot){
+                slots[job.slot] = job.pos;
+                continue;
+            }
+
+            // run this thread until it fails; choices are pushed as we go
+            uint32_t pc = job.pc;
+            size_t pos = job.pos;
+            bool alive = true;
+            while (alive){
+                if (++steps > limit || stack.size() >= kMaxStack) return Outcome::OutOfBudget;
+                if (memo && memo_index_[pc] != kNoSlot){
+                    size_t bit = memo_index_[pc] * row + pos;
+                    uint64_t& word = m.visited[bit / 64];
+                    uint64_t mask = uint64_t(1) << (bit % 64);
+                    if (word & mask){ alive = false; break; } // been here: no match from it
+                    word |= mask;
+                }
+                if (loop_slot_[pc] != kNoSlot) set_slot(loop_slot_[pc], pos);
+
+                const Inst& in = prog_.insts[pc];
+                switch (in.op){
+                    case Op::Byte:
+                        alive = pos < n && prog_.sets[in.x].contains(static_cast<unsigned char>(s[pos]));
+                        ++pos; ++pc;
+                        break;
+                    case Op::Run: {
+                        // measure the whole run once, then go on with the
+                        // longest (greedy) or shortest (lazy) length allowed
+                        // and keep the others for later on one choice point
+                        const Repeat& rep = prog_.repeats[in.y];
+                        size_t cap = rep.max == kUnbounded ? n : std::min(n - pos, size_t(rep.max)) + pos;
+                        size_t end = prog_.sets[in.x].span(s.substr(0, cap), pos);
+                        steps += end - pos;
+                        size_t lo = pos + rep.min;
+                        alive = lo <= end;
+                        if (!alive) break;
+                        size_t take = rep.lazy ? lo : end;
+                        if (lo < end) stack.push_back({pc + 1, kRun, rep.lazy ? lo + 1 : end - 1,
+                                                       rep.lazy ? end : lo});
+                        pos = take;
+                        ++pc;
+                        break;
+                    }
+                    case Op::Split: {
+                        uint32_t body = loop_start(in, pc);
+                        if (body != kNoLoop && slots[loop_slot_[body]] == pos){
+                            pc = body == in.x ? in.y : in.x; // the last iteration was empty
+                        } else {
+                            stack.push_back({in.y, kNoSlot, pos});
+                            pc = in.x;
+                        }
+                        break;
+                    }
+                    case Op::Jmp:
+                        pc = in.x;
+                        break;
+                    case Op::Save:
+                        set_slot(in.x, pos);
+                        ++pc;
+                        break;
+                    case Op::Bol:
+                        alive = pos == 0;
+                        ++pc;
+                        break;
+                    case Op::Eol:
+                        alive = pos == n;
+                        ++pc;
+                        break;
+                    case Op::BackRef: {
+                        size_t b = slots[2 * in.x], e = slots[2 * in.x + 1];
+                        if (b == kUnset || e == kUnset || e < b){ alive = false; break; }
+                        size_t len = e - b;
+                        steps += len; // the compare is as much work as len bytes
+                        alive = len <= n - pos &&
+                                (prog_.ignore_case ? equal_fold(s.data() + pos, s.data() + b, len)
+                                                   : s.compare(pos, len, s.substr(b, len)) == 0);
+                        pos += len; ++pc;
+                        break;
+                    }
+                    case Op::Match:
+                        if (!longest){
+                            if (out) *out = {start, pos};
+                            return Outcome::Match;
+                        }
+                        // keep unwinding: another way through may end later
+                        if (!found || pos > longest_end) longest_end = pos;
+                        found = true;
+                        alive = false;
+                        break;
+                    case Op::Fail:
+                        alive = false;
+                        break;
+                }
+            }
+        }
+        if (found){
+            if (out) *out = {start, longest_end};
+            return Outcome::Match;
+        }
+    }
+    return Outcome::NoMatch;
+}
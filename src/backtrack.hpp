@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "grepcore.hpp"
+#include "prog.hpp"
+
+// Backtracking matcher over a Prog, for the patterns the DFA can't run
+// (backreferences). The alternatives still to be tried sit on an explicit
+// stack of choice points on the heap, not on the call stack, so a 1 MB line
+// can't overflow anything; capture writes are pushed on the same stack and
+// undone as it unwinds.
+//
+// Where no BackRef can be reached any more, what the rest of the pattern
+// does from an instruction depends only on the input position, not on what
+// the groups captured. There a bit per (pc, pos) records the states already
+// visited, as in RE2's BitState: a second visit can only fail the same way,
+// so it is cut off and that part of the pattern runs in O(insts * line)
+// however its quantifiers nest. Instructions that can still reach a BackRef
+// are backtracked in full, since the captures decide the outcome there.
+//
+// Each line gets a budget of steps (instructions run, plus bytes compared by
+// backreferences). A line that runs out of it, or that would grow the stack
+// past kMaxStack entries, is given up on: the result is OutOfBudget and the
+// caller treats the line as not matching.
+class Backtracker {
+public:
+    enum class Outcome { NoMatch, Match, OutOfBudget };
+
+    static constexpr size_t kMaxStack = size_t(1) << 22; // 96 MiB of choice points
+    static constexpr size_t kMaxMemoBits = size_t(1) << 25; // 4 MiB of visited bits
+
+    // step_budget == 0 means no step limit (the stack limit still applies)
+    Backtracker(const Prog& prog, uint64_t step_budget);
+
+    // unanchored search of one line; the scratch stack is per thread, so
+    // one Backtracker can be shared
+    Outcome match(std::string_view line) const;
+
+    // The leftmost match starting at or after `from`: the first one found
+    // there, or with `longest` the longest, which means trying every way
+    // through the pattern from that start (all of it counts against the
+    // budget). `out` may be null.
+    Outcome find(std::string_view line, size_t from, bool longest, grepcore::Span* out) const;
+
+private:
+    static constexpr uint32_t kNoSlot = 0xFFFFFFFFu;
+    static constexpr uint32_t kRun = kNoSlot - 1;
+
+    const Prog& prog_;
+    uint64_t budget_;
+    // Per pc: for the first instruction of a loop body, the slot that
+    // records where the current iteration started, else kNoSlot. An
+    // iteration that consumed nothing doesn't loop again. Atom repeats are
+    // Run instructions instead: the run is measured with ByteSet::span()
+    // and a single choice point hands the other lengths out one at a time.
+    std::vector<uint32_t> loop_slot_;
+    uint32_t nslots_ = 0;      // capture slots followed by loop slots
+    // Per pc: its row in the visited bits if no BackRef is reachable from
+    // it, else kNoSlot.
+    std::vector<uint32_t> memo_index_;
+    size_t nmemo_ = 0;
+};
@@ -0,0 +1,77 @@
+#include "byteset.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BYTESET_X86 1
+#endif
+
+struct SpanImpl {
+    static size_t scalar(const ByteSet& b, const char* s, size_t n, size_t from){
+        while (from < n && b.table_[static_cast<unsigned char>(s[from])]) ++from;
+        return from;
+    }
+
+#ifdef BYTESET_X86
+    __attribute__((target("avx2")))
+    static size_t avx2(const ByteSet& b, const char* s, size_t n, size_t from){
+        const __m256i row0 = _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(b.lo_lut_[0])));
+        const __m256i row1 = _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(b.lo_lut_[1])));
+        const __m256i bit_of = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                                1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        const __m256i nib = _mm256_set1_epi8(0x0f);
+        const __m256i seven = _mm256_set1_epi8(7);
+        size_t i = from;
+        for (; i + 32 <= n; i += 32){
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+            __m256i lo = _mm256_and_si256(v, nib);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nib);
+            __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(row0, lo),
+                                             _mm256_shuffle_epi8(row1, lo),
+                                             _mm256_cmpgt_epi8(hi, seven));
+            __m256i bit = _mm256_shuffle_epi8(bit_of, hi);
+            uint32_t in = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit)));
+            if (in != 0xFFFFFFFFu) return i + __builtin_ctz(~in);
+        }
+        return scalar(b, s, n, i);
+    }
+
+    __attribute__((target("ssse3")))
+    static size_t ssse3(const ByteSet& b, const char* s, size_t n, size_t from){
+        const __m128i row0 = _mm_load_si128(reinterpret_cast<const __m128i*>(b.lo_lut_[0]));
+        const __m128i row1 = _mm_load_si128(reinterpret_cast<const __m128i*>(b.lo_lut_[1]));
+        const __m128i bit_of = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        const __m128i nib = _mm_set1_epi8(0x0f);
+        const __m128i seven = _mm_set1_epi8(7);
+        size_t i = from;
+        for (; i + 16 <= n; i += 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            __m128i lo = _mm_and_si128(v, nib);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+            __m128i upper = _mm_cmpgt_epi8(hi, seven);
+            __m128i row = _mm_or_si128(_mm_andnot_si128(upper, _mm_shuffle_epi8(row0, lo)),
+                                       _mm_and_si128(upper, _mm_shuffle_epi8(row1, lo)));
+            __m128i bit = _mm_shuffle_epi8(bit_of, hi);
+            uint32_t in = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit)));
+            if (in != 0xFFFFu) return i + __builtin_ctz(~in);
+        }
+        return scalar(b, s, n, i);
+    }
+#endif
+};
+
+ByteSet::ByteSet(const std::bitset<256>& bits) : bits_(bits), lo_lut_{} {
+    for (int c = 0; c < 256; ++c){
+        table_[c] = bits_[c];
+        if (bits_[c]) lo_lut_[c >> 7][c & 15] |= static_cast<uint8_t>(1u << ((c >> 4) & 7));
+    }
+
+    span_ = &SpanImpl::scalar;
+#ifdef BYTESET_X86
+    if (__builtin_cpu_supports("avx2")) span_ = &SpanImpl::avx2;
+    else if (__builtin_cpu_supports("ssse3")) span_ = &SpanImpl::ssse3;
+#endif
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// A set of bytes as the matchers use it: membership is one table load, and
+// span() measures a run of member bytes 32 (AVX2) or 16 (SSSE3) at a time
+// with two nibble lookups per block. The variant is picked once per set.
+class ByteSet {
+public:
+    ByteSet() : ByteSet(std::bitset<256>()) {}
+    explicit ByteSet(const std::bitset<256>& bits);
+
+    bool contains(unsigned char c) const { return table_[c]; }
+    const std::bitset<256>& bits() const { return bits_; }
+    bool operator==(const ByteSet& o) const { return bits_ == o.bits_; }
+
+    // end of the run of member bytes that starts at `from`
+    size_t span(std::string_view s, size_t from) const {
+        return span_(*this, s.data(), s.size(), from);
+    }
+
+    using SpanFn = size_t (*)(const ByteSet&, const char*, size_t, size_t);
+
+private:
+    friend struct SpanImpl;
+
+    std::bitset<256> bits_;
+    bool table_[256];
+    // bit (hi & 7) of lo_lut_[hi >= 8][lo] is set when (hi << 4 | lo) is in
+    // the set; the vector scans look both rows up with pshufb
+    alignas(16) uint8_t lo_lut_[2][16];
+    SpanFn span_ = nullptr;
+};
+
+// ASCII case folding for -i: letters fold to lower case, other bytes stay
+inline unsigned char fold_case(unsigned char c){
+    return static_cast<unsigned>(c - 'A') < 26 ? c | 0x20 : c;
+}
+
+inline bool equal_fold(const char* a, const char* b, size_t n){
+    for (size_t i = 0; i < n; ++i){
+        if (fold_case(a[i]) != fold_case(b[i])) return false;
+    }
+    return true;
+}
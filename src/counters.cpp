@@ -0,0 +1,38 @@
+#include "counters.hpp"
+#include "grepcore.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace counters {
+
+namespace {
+
+std::mutex g_m;
+std::vector<Block*> g_blocks; // never freed: read after their threads are gone
+
+} // namespace
+
+Block& local(){
+    thread_local Block* block = []{
+        auto* b = new Block;
+        std::lock_guard<std::mutex> lk(g_m);
+        g_blocks.push_back(b);
+        return b;
+    }();
+    return *block;
+}
+
+} // namespace counters
+
+grepcore::EngineCounters grepcore::engine_counters(){
+    EngineCounters sum;
+    std::lock_guard<std::mutex> lk(counters::g_m);
+    for (const counters::Block* b : counters::g_blocks){
+        sum.starts += b->starts.load(std::memory_order_relaxed);
+        sum.steps += b->steps.load(std::memory_order_relaxed);
+        sum.dfa_states += b->dfa_states.load(std::memory_order_relaxed);
+        sum.dfa_flushes += b->dfa_flushes.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// The per-thread blocks behind grepcore::engine_counters(). Each thread
+// counts into its own block, which only it writes: an add is a relaxed
+// load and store, no locked instruction. Blocks are registered on a
+// thread's first count and outlive it, so the work of pool threads that
+// have exited is still summed.
+//
+// Engines count once per call (a find() or a new DFA state), not per byte.
+namespace counters {
+
+struct Block {
+    std::atomic<uint64_t> starts{0};
+    std::atomic<uint64_t> steps{0};
+    std::atomic<uint64_t> dfa_states{0};
+    std::atomic<uint64_t> dfa_flushes{0};
+};
+
+// this thread's block
+Block& local();
+
+inline void add(std::atomic<uint64_t>& c, uint64_t n){
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+} // namespace counters
@@ -0,0 +1,269 @@
+#include "decompress.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef GREP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GREP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static constexpr size_t kReadSize = 256 << 10;
+
+// The compressed bytes, piece by piece: a mapping in one go, a descriptor
+// as the bytes already read from it and then one read() at a time. A
+// descriptor is only read once poll() says so, and the wake pipe ends the
+// wait: a read() on a quiet pipe would block the destructor's join.
+class Decompressor::Source {
+public:
+    explicit Source(Decompressor& d) : d_(d) {}
+
+    // false at the end of the input, on a read error (failed() is set), or
+    // once the consumer is gone
+    bool next(std::string_view& piece){
+        if (!d_.data_.empty() || d_.fd_ < 0){
+            if (done_) return false;
+            done_ = true;
+            piece = d_.data_;
+            return !piece.empty();
+        }
+        if (!done_){
+            done_ = true;
+            if (!d_.head_.empty()){ piece = d_.head_; return true; }
+        }
+        if (!buf_) buf_.reset(new char[kReadSize]);
+        for (;;){
+            pollfd fds[2] = {{d_.fd_, POLLIN, 0}, {d_.wake_[0], POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0){
+                if (errno == EINTR) continue;
+                failed_ = std::system_category().message(errno);
+                return false;
+            }
+            if (fds[1].revents) return false;
+            ssize_t n = ::read(d_.fd_, buf_.get(), kReadSize);
+            if (n > 0){ piece = std::string_view(buf_.get(), n); return true; }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) failed_ = std::system_category().message(errno);
+            return false;
+        }
+    }
+
+    // whether next() can return without waiting on the descriptor
+    bool ready() const {
+        if (!d_.data_.empty() || d_.fd_ < 0 || !done_) return true;
+        pollfd fd{d_.fd_, POLLIN, 0};
+        return ::poll(&fd, 1, 0) != 0;
+    }
+
+    const std::string& failed() const { return failed_; }
+
+private:
+    Decompressor& d_;
+    bool done_ = false;
+    std::unique_ptr<char[]> buf_;
+    std::string failed_;
+};
+
+Decompressor::Format Decompressor::sniff(std::string_view head){
+    auto starts = [&](std::string_view magic){ return head.substr(0, magic.size()) == magic; };
+    if (starts("\x1f\x8b")) return Format::Gzip;
+    if (starts("\x28\xb5\x2f\xfd")) return Format::Zstd;
+    return Format::None;
+}
+
+bool Decompressor::supported(Format f){
+    switch (f){
+#ifdef GREP_HAVE_ZLIB
+        case Format::Gzip: return true;
+#endif
+#ifdef GREP_HAVE_ZSTD
+        case Format::Zstd: return true;
+#endif
+        default: return false;
+    }
+}
+
+const char* Decompressor::name(Format f){
+    switch (f){
+        case Format::Gzip: return "gzip";
+        case Format::Zstd: return "zstd";
+        default: return "plain";
+    }
+}
+
+Decompressor::Decompressor(Format f, std::string_view data) : format_(f), data_(data) {
+    start();
+}
+
+Decompressor::Decompressor(Format f, int fd, std::string head)
+    : format_(f), fd_(fd), head_(std::move(head)) {
+    // without the pipe, poll() skips the -1 and only the input ends a wait
+    if (::pipe2(wake_, O_CLOEXEC) < 0) wake_[0] = wake_[1] = -1;
+    start();
+}
+
+Decompressor::~Decompressor(){
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (wake_[1] >= 0){
+        char c = 0;
+        while (::write(wake_[1], &c, 1) < 0 && errno == EINTR){}
+    }
+    producer_.join();
+    for (int fd : wake_) if (fd >= 0) ::close(fd);
+}
+
+void Decompressor::start(){
+    producer_ = std::thread([this]{
+        Source src(*this);
+        produce(src);
+        std::lock_guard<std::mutex> lk(m_);
+        if (error_.empty() && !src.failed().empty()) error_ = src.failed();
+        finished_ = true;
+        cv_.notify_all();
+    });
+}
+
+bool Decompressor::publish(size_t len){
+    std::unique_lock<std::mutex> lk(m_);
+    blocks_[fill_].len = len;
+    blocks_[fill_].full = true;
+    fill_ ^= 1;
+    cv_.notify_all();
+    cv_.wait(lk, [&]{ return !blocks_[fill_].full || stop_; });
+    return !stop_;
+}
+
+// Decode into blocks_[fill_] and publish it whenever it is full, or before
+// waiting on a pipe with part of it filled, so a match is seen as soon as
+// its bytes come in. Errors are recorded for the consumer; what was decoded
+// up to them is kept.
+void Decompressor::produce(Source& src){
+    auto fail = [&](std::string what){
+        std::lock_guard<std::mutex> lk(m_);
+        error_ = std::string(name(format_)) + ": " + what;
+    };
+    std::string_view in;
+    size_t used = 0;
+
+    if (format_ == Format::Gzip){
+#ifdef GREP_HAVE_ZLIB
+        z_stream z{};
+        if (inflateInit2(&z, 15 + 32) != Z_OK){ fail("out of memory"); return; } // gzip header
+        bool ended = false;
+        // a full block may leave a match half copied; it is finished
+        // before more input is asked for
+        bool drained = true;
+        for (;;){
+            if (z.avail_in == 0 && drained){
+                if (used && !src.ready()){
+                    if (!publish(used)){ inflateEnd(&z); return; }
+                    used = 0;
+                }
+                if (!src.next(in)){
+                    if (!ended && src.failed().empty()) fail("unexpected end of file");
+                    break;
+                }
+                z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+                z.avail_in = static_cast<uInt>(in.size());
+            }
+            if (ended){
+                // another member follows, as `cat a.gz b.gz` makes; anything
+                // else after the end is ignored, as gzip -d does
+                if (z.next_in[0] != 0x1f){ break; }
+                inflateReset(&z);
+                ended = false;
+            }
+            z.next_out = reinterpret_cast<Bytef*>(blocks_[fill_].data.get() + used);
+            z.avail_out = static_cast<uInt>(kBlockSize - used);
+            int r = inflate(&z, Z_NO_FLUSH);
+            used = kBlockSize - z.avail_out;
+            drained = used < kBlockSize || r == Z_STREAM_END;
+            if (r == Z_STREAM_END) ended = true;
+            else if (r != Z_OK && !(r == Z_BUF_ERROR && z.avail_in == 0)){
+                fail(z.msg ? z.msg : "invalid compressed data");
+                break;
+            }
+            if (used == kBlockSize){
+                if (!publish(used)){ inflateEnd(&z); return; }
+                used = 0;
+            }
+        }
+        inflateEnd(&z);
+#else
+        fail("not supported by this build (configure with zlib)");
+#endif
+    } else if (format_ == Format::Zstd){
+#ifdef GREP_HAVE_ZSTD
+        ZSTD_DStream* ds = ZSTD_createDStream();
+        if (!ds){ fail("out of memory"); return; }
+        ZSTD_initDStream(ds);
+        ZSTD_inBuffer zin{nullptr, 0, 0};
+        size_t hint = 1; // 0 once a frame is complete
+        // a full block may leave decoded bytes inside the decoder; they
+        // are flushed before more input is asked for
+        bool drained = true;
+        for (;;){
+            if (zin.pos == zin.size && drained){
+                if (used && !src.ready()){
+                    if (!publish(used)){ ZSTD_freeDStream(ds); return; }
+                    used = 0;
+                }
+                if (!src.next(in)){
+                    if (hint != 0 && src.failed().empty()) fail("unexpected end of file");
+                    break;
+                }
+                zin = ZSTD_inBuffer{in.data(), in.size(), 0};
+            }
+            ZSTD_outBuffer zout{blocks_[fill_].data.get(), kBlockSize, used};
+            hint = ZSTD_decompressStream(ds, &zout, &zin);
+            used = zout.pos;
+            if (ZSTD_isError(hint)){
+                fail(ZSTD_getErrorName(hint));
+                break;
+            }
+            drained = used < kBlockSize || hint == 0;
+            if (used == kBlockSize){
+                if (!publish(used)){ ZSTD_freeDStream(ds); return; }
+                used = 0;
+            }
+        }
+        ZSTD_freeDStream(ds);
+#else
+        fail("not supported by this build (configure with libzstd)");
+#endif
+    }
+    if (used) publish(used);
+}
+
+ssize_t Decompressor::read(char* dst, size_t n){
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&]{ return blocks_[drain_].full || finished_; });
+    Block& b = blocks_[drain_];
+    if (!b.full) return error_.empty() ? 0 : -1;
+    lk.unlock();
+
+    // the producer keeps off a full block, so it is copied unlocked
+    size_t k = std::min(n, b.len - pos_);
+    std::memcpy(dst, b.data.get() + pos_, k);
+    pos_ += k;
+    if (pos_ == b.len){
+        lk.lock();
+        b.full = false;
+        drain_ ^= 1;
+        pos_ = 0;
+        cv_.notify_all();
+    }
+    return static_cast<ssize_t>(k);
+}
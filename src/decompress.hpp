@@ -0,0 +1,75 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// -z: gzip and zstd input, told apart by their magic bytes. A producer
+// thread decodes into two kBlockSize buffers, one ahead of the one the
+// consumer is reading, so decoding one block overlaps with matching the
+// one before. gzip needs zlib and zstd libzstd at build time
+// (GREP_HAVE_ZLIB, GREP_HAVE_ZSTD); a format without its library is
+// recognized but can't be read.
+class Decompressor {
+public:
+    static constexpr size_t kBlockSize = 1 << 20;
+
+    enum class Format { None, Gzip, Zstd };
+
+    // the format `head` (the first bytes of an input) starts with
+    static Format sniff(std::string_view head);
+    static bool supported(Format f);
+    static const char* name(Format f);
+
+    // Decode `f` from `data` (e.g. a mapped file), or from what is left of
+    // `fd` after `head`, the bytes already read from it; fd is not closed.
+    Decompressor(Format f, std::string_view data);
+    Decompressor(Format f, int fd, std::string head);
+    ~Decompressor();
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    // like read(2): up to `n` decoded bytes, 0 at the end, -1 once the
+    // input turned out to be damaged (see error())
+    ssize_t read(char* dst, size_t n);
+
+    // why decoding stopped early; "" if it didn't. Valid once read() has
+    // returned 0 or -1.
+    const std::string& error() const { return error_; }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data{new char[kBlockSize]};
+        size_t len = 0;
+        bool full = false;
+    };
+    class Source;
+
+    void start();
+    void produce(Source& src);
+    // hand a decoded block over and wait for the next empty one; false
+    // once the consumer has gone away
+    bool publish(size_t len);
+
+    Format format_;
+    std::string_view data_;
+    int fd_ = -1;
+    std::string head_;
+    // written to when the consumer goes away, so a producer waiting on
+    // fd_ (a pipe that may never say more) wakes up; -1 -1 for a mapping
+    int wake_[2] = {-1, -1};
+
+    Block blocks_[2];
+    size_t fill_ = 0;          // block the producer writes next
+    size_t drain_ = 0;         // block the consumer reads
+    size_t pos_ = 0;           // ...and how far
+    bool finished_ = false;    // no blocks after the full ones
+    bool stop_ = false;        // the consumer is gone
+    std::string error_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::thread producer_;
+};
@@ -0,0 +1,245 @@
+#include "dfa.hpp"
+#include "counters.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+size_t Dfa::KeyHash::operator()(const std::vector<Entry>& v) const {
+    size_t h = v.size();
+    for (Entry x : v) h = (h ^ x ^ (x >> 32)) * 0x100000001b3ULL;
+    return h;
+}
+
+Dfa::Dfa(const Prog& prog) : prog_(prog) {
+    // Byte classes: two bytes share a class when no set tells them apart, so
+    // the transition table only needs one column per class.
+    std::fill(std::begin(class_of_), std::end(class_of_), 0);
+    nclasses_ = 1;
+    for (const auto& set : prog_.sets){
+        int remap[256][2];
+        for (auto& r : remap) r[0] = r[1] = -1;
+        int n = 0;
+        for (int c = 0; c < 256; ++c){
+            int& id = remap[class_of_[c]][set.contains(c)];
+            if (id < 0) id = n++;
+            class_of_[c] = static_cast<uint8_t>(id);
+        }
+        nclasses_ = n;
+    }
+    for (int c = 255; c >= 0; --c) class_rep_[class_of_[c]] = static_cast<uint8_t>(c);
+
+    std::bitset<256> skip = ~prog_.first;
+    skip.reset('\n');
+    skip_ = ByteSet(skip);
+
+    seen_gen_.assign(prog_.insts.size(), 0);
+    reset_cache();
+    TRACE("dfa", prog_.insts.size() << " insts, " << nclasses_ << " byte classes");
+}
+
+// Follow the empty transitions from pc and collect the instructions where a
+// thread has to wait: for a byte (Byte, or a Run at count 0), for the end of
+// line (Eol) or done.
+void Dfa::closure(uint32_t pc, bool at_start, bool at_end){
+    work_.push_back(pc);
+    while (!work_.empty()){
+        uint32_t p = work_.back(); work_.pop_back();
+        if (seen_gen_[p] == gen_) continue;
+        seen_gen_[p] = gen_;
+
+        const Inst& in = prog_.insts[p];
+        switch (in.op){
+            case Op::Byte:
+            case Op::Run:
+            case Op::Match:
+                build_.push_back(entry(p));
+                break;
+            case Op::Eol:
+                if (at_end) work_.push_back(p + 1);
+                else build_.push_back(entry(p));
+                break;
+            case Op::Bol:
+                if (at_start) work_.push_back(p + 1);
+                break;
+            case Op::Split:
+                work_.push_back(in.y);
+                work_.push_back(in.x);
+                break;
+            case Op::Jmp:
+                work_.push_back(in.x);
+                break;
+            case Op::Save:
+                work_.push_back(p + 1);
+                break;
+            case Op::BackRef: // never compiled into a Dfa
+            case Op::Fail:
+                break;
+        }
+    }
+}
+
+// Threads in the same bounded Run that have both reached its min differ
+// only in how many more bytes they may take: the one with the lowest count
+// can do all the others can, so it is the only one kept. build_ is sorted.
+void Dfa::drop_subsumed(){
+    size_t out = 0;
+    uint32_t done_pc = kNoLoop; // a Run whose lowest count past min is kept
+    for (size_t k = 0; k < build_.size(); ++k){
+        Entry e = build_[k];
+        if (out && build_[out - 1] == e) continue;
+        const Inst& in = prog_.insts[pc_of(e)];
+        if (in.op == Op::Run && count_of(e) >= prog_.repeats[in.y].min){
+            if (done_pc == pc_of(e)) continue;
+            done_pc = pc_of(e);
+        }
+        build_[out++] = e;
+    }
+    build_.resize(out);
+}
+
+// Look up (or create) the state for the instruction set in build_.
+int Dfa::intern(bool initial){
+    // step() keeps a Run's entries in order, so past a few closure entries
+    // the set is mostly sorted already; a state of a large counted repeat
+    // is then merged in linear time instead of sorted again
+    auto sorted = std::is_sorted_until(build_.begin(), build_.end());
+    std::sort(sorted, build_.end());
+    std::inplace_merge(build_.begin(), sorted, build_.end());
+    drop_subsumed();
+    if (initial) build_.push_back(kStartMarker); // '^' may still hold at the end
+    auto it = index_.find(build_);
+    if (it != index_.end()) return it->second;
+
+    int id = static_cast<int>(states_.size());
+    index_.emplace(build_, id);
+    if (initial) build_.pop_back();
+
+    State st;
+    st.insts = build_;
+    for (Entry e : st.insts){
+        if (prog_.insts[pc_of(e)].op == Op::Match) st.match = true;
+    }
+    st.match_at_end = st.match;
+    if (!st.match){
+        ++gen_;
+        build_.clear();
+        for (Entry e : st.insts){
+            if (prog_.insts[pc_of(e)].op == Op::Eol) closure(pc_of(e), initial, true);
+        }
+        for (Entry e : build_){
+            if (prog_.insts[pc_of(e)].op == Op::Match) st.match_at_end = true;
+        }
+    }
+    entries_ += st.insts.size();
+    states_.push_back(std::move(st));
+    counters::add(counters::local().dfa_states, 1);
+    trans_.resize(states_.size() * nclasses_, -1);
+    return id;
+}
+
+void Dfa::reset_cache(){
+    states_.clear();
+    trans_.clear();
+    index_.clear();
+    entries_ = 0;
+
+    ++gen_;
+    build_.clear();
+    closure(prog_.start, true, false);
+    initial_ = intern(true);
+
+    ++gen_;
+    build_.clear();
+    closure(prog_.start, false, false);
+    restart_ = intern(false);
+}
+
+int Dfa::step(int s, int cls){
+    uint8_t b = class_rep_[cls];
+    ++gen_;
+    build_.clear();
+    for (Entry e : states_[s].insts){
+        uint32_t p = pc_of(e);
+        const Inst& in = prog_.insts[p];
+        if (in.op == Op::Eol || in.op == Op::Match || !prog_.sets[in.x].contains(b)) continue;
+        if (in.op == Op::Byte){
+            closure(p + 1, false, false);
+            continue;
+        }
+        // a Run takes one more byte; past min an unbounded one stops counting
+        const Repeat& rep = prog_.repeats[in.y];
+        uint32_t count = count_of(e) + 1;
+        if (count >= rep.min) closure(p + 1, false, false);
+        if (count < rep.max) build_.push_back(entry(p, rep.max == kUnbounded ? std::min(count, rep.min) : count));
+    }
+    // unanchored search: a new match attempt may begin after every byte
+    closure(prog_.start, false, false);
+
+    if (states_.size() >= kMaxStates || entries_ + build_.size() > kMaxEntries){
+        // bound memory: throw the cache away and keep going from here
+        TRACE("dfa", "cache flushed at " << states_.size() << " states, " << entries_ << " entries");
+        counters::add(counters::local().dfa_flushes, 1);
+        std::vector<Entry> pending;
+        pending.swap(build_);
+        reset_cache();
+        build_.swap(pending);
+        return intern(false);
+    }
+    int t = intern(false);
+    trans_[static_cast<size_t>(s) * nclasses_ + cls] = t;
+    return t;
+}
+
+bool Dfa::match(std::string_view line){
+    int s = initial_;
+    if (states_[s].match) return true;
+    for (size_t i = 0; i < line.size(); ++i){
+        if (s == restart_){
+            i = skip_.span(line, i);
+            if (i == line.size()) break;
+        }
+        int cls = class_of_[static_cast<unsigned char>(line[i])];
+        int t = trans_[static_cast<size_t>(s) * nclasses_ + cls];
+        if (t < 0) t = step(s, cls);
+        s = t;
+        const State& st = states_[s];
+        if (st.match) return true;
+        if (st.insts.empty()) return false; // nothing left alive (anchored pattern)
+    }
+    return states_[s].match_at_end;
+}
+
+size_t Dfa::scan(std::string_view buf, size_t from){
+    const char* p = buf.data();
+    size_t i = from, n = buf.size();
+    while (i < n){
+        // at the start of a line
+        int s = initial_;
+        if (states_[s].match) return i;
+        for (; i < n; ++i){
+            if (s == restart_){
+                i = skip_.span(buf, i);
+                if (i == n) break;
+            }
+            unsigned char c = p[i];
+            if (c == '\n') break;
+            int cls = class_of_[c];
+            int t = trans_[static_cast<size_t>(s) * nclasses_ + cls];
+            if (t < 0) t = step(s, cls);
+            s = t;
+            const State& st = states_[s];
+            if (st.match) return i;
+            if (st.insts.empty()){
+                // anchored pattern already failed: skip the rest of the line
+                const void* nl = std::memchr(p + i, '\n', n - i);
+                i = nl ? static_cast<const char*>(nl) - p : n;
+                break;
+            }
+        }
+        if (states_[s].match_at_end) return i;
+        ++i; // past the '\n'
+    }
+    return std::string_view::npos;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "prog.hpp"
+
+// Lazily built DFA over a backreference-free Prog. Each DFA state is the set
+// of NFA instructions alive after some input; states and transitions are
+// created the first time they are needed and cached, so matching a line is a
+// single table walk: O(n) no matter how the pattern nests its quantifiers.
+// Where no match is in progress the walk jumps ahead to the next byte that
+// can begin one.
+class Dfa {
+public:
+    explicit Dfa(const Prog& prog);
+
+    // unanchored search: does the pattern match anywhere in the line?
+    bool match(std::string_view line);
+
+    // scan a run of '\n'-terminated lines starting at a line start; returns
+    // an offset inside the first matching line (its '\n' counts as part of
+    // it) or npos
+    size_t scan(std::string_view buf, size_t from);
+
+    size_t state_count() const { return states_.size(); }
+
+private:
+    // An NFA thread in a state: its pc in the high half and, at a Run, the
+    // bytes the run has consumed so far in the low half.
+    using Entry = uint64_t;
+    static Entry entry(uint32_t pc, uint32_t count = 0){ return Entry(pc) << 32 | count; }
+    static uint32_t pc_of(Entry e){ return static_cast<uint32_t>(e >> 32); }
+    static uint32_t count_of(Entry e){ return static_cast<uint32_t>(e); }
+
+    struct State {
+        std::vector<Entry> insts;    // Byte, Run and Eol instructions still alive
+        bool match = false;          // Match reached without consuming more
+        bool match_at_end = false;   // Match reached if the line ends here
+    };
+    struct KeyHash {
+        size_t operator()(const std::vector<Entry>& v) const;
+    };
+
+    // The cache is flushed past either bound. States of counted repeats
+    // hold one entry per count still alive, so the entries are bounded too:
+    // 10000 states of a{30000} would be gigabytes.
+    static constexpr size_t kMaxStates = 10000;
+    static constexpr size_t kMaxEntries = size_t(1) << 20;
+    static constexpr Entry kStartMarker = ~Entry(0);
+
+    void closure(uint32_t pc, bool at_start, bool at_end);
+    void drop_subsumed();
+    int intern(bool initial);
+    int step(int s, int cls);
+    void reset_cache();
+
+    const Prog& prog_;
+    int nclasses_ = 0;
+    uint8_t class_of_[256];
+    uint8_t class_rep_[256];   // one representative byte per class
+
+    std::vector<State> states_;
+    std::vector<int32_t> trans_;  // states_ x classes, -1 = not built yet
+    std::unordered_map<std::vector<Entry>, int, KeyHash> index_;
+    size_t entries_ = 0;          // in all of states_
+    int initial_ = -1;            // state at the start of a line
+    // State with nothing in flight past the start of a line. It only leaves
+    // itself on a byte a match can begin with (or '\n'), so runs of other
+    // bytes are skipped with skip_.span() instead of stepped through.
+    int restart_ = -1;
+    ByteSet skip_;
+
+    // scratch for closure(): a sparse set of visited pcs
+    std::vector<uint32_t> seen_gen_;
+    uint32_t gen_ = 0;
+    std::vector<uint32_t> work_;
+    std::vector<Entry> build_;
+};
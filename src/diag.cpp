@@ -0,0 +1,7 @@
+#include "diag.hpp"
+
+#include <iostream>
+
+void report(const std::string& name, const std::string& what){
+    std::cerr << (name + ": " + what + "\n") << std::flush;
+}
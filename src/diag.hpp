@@ -0,0 +1,7 @@
+#pragma once
+#include <string>
+
+// "name: what" on stderr for a file or directory that couldn't be searched.
+// Each message is one write, so messages from several threads don't
+// interleave.
+void report(const std::string& name, const std::string& what);
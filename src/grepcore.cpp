@@ -0,0 +1,157 @@
+#include "grepcore.hpp"
+#include "aho_corasick.hpp"
+#include "pattern_set.hpp"
+#include "prefilter.hpp"
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace grepcore {
+
+static std::string_view as_chars(Bytes b){
+    return std::string_view(reinterpret_cast<const char*>(b.data()), b.size());
+}
+
+// the line around `hit`, which lies in a line at or after `from`
+static Span line_at(std::string_view buf, size_t from, size_t hit){
+    const void* prev = memrchr(buf.data() + from, '\n', hit - from);
+    const void* nl = std::memchr(buf.data() + hit, '\n', buf.size() - hit);
+    return {prev ? static_cast<const char*>(prev) - buf.data() + 1 : from,
+            nl ? static_cast<const char*>(nl) - buf.data() : buf.size()};
+}
+
+static std::unique_ptr<PatternSet> build(const std::vector<std::string>& patterns,
+                                         const CompileOptions& opts){
+    RegexOptions ropts;
+    ropts.step_budget = opts.step_budget;
+    ropts.ignore_case = opts.ignore_case;
+    return std::make_unique<PatternSet>(patterns, opts.fixed_strings, ropts);
+}
+
+Matcher::Matcher(const std::vector<std::string>& patterns, const CompileOptions& opts)
+    : set_(build(patterns, opts)), kind_(opts.match_kind) {}
+
+Matcher::Matcher(std::string_view pattern, const CompileOptions& opts)
+    : Matcher(std::vector<std::string>{std::string(pattern)}, opts) {}
+
+Matcher::~Matcher() = default;
+Matcher::Matcher(Matcher&&) noexcept = default;
+Matcher& Matcher::operator=(Matcher&&) noexcept = default;
+
+bool Matcher::match(std::string_view line) const { return set_->match(line); }
+bool Matcher::match(Bytes line) const { return match(as_chars(line)); }
+
+std::optional<Span> Matcher::find(std::string_view buf, size_t from) const {
+    Scanner sc(*this, buf);
+    size_t hit = sc.next(from);
+    if (hit == std::string_view::npos) return std::nullopt;
+    return line_at(buf, from, hit);
+}
+
+std::optional<Span> Matcher::find(Bytes buf, size_t from) const {
+    return find(as_chars(buf), from);
+}
+
+std::optional<Span> Matcher::find_match(std::string_view line, size_t from) const {
+    return Matches(*this, line, from).next();
+}
+
+std::vector<EnginePlan> Matcher::plan() const {
+    std::vector<EnginePlan> out;
+    for (uint8_t e = 0; e < 3; ++e){
+        EnginePlan p;
+        for (size_t k = 0; k < set_->engine_of_.size(); ++k){
+            if (set_->engine_of_[k] == e) p.patterns.push_back(k);
+        }
+        if (p.patterns.empty()) continue;
+        if (e == 0){
+            p.engine = "aho-corasick";
+        } else {
+            const Regex& re = e == 1 ? *set_->regex_ : *set_->backref_;
+            p.engine = re.engine();
+            p.prefilter = re.prefilter_literal();
+        }
+        out.push_back(std::move(p));
+    }
+    return out;
+}
+
+Matcher compile(std::string_view pattern, const CompileOptions& opts){
+    return Matcher(pattern, opts);
+}
+
+Matcher compile(const std::vector<std::string>& patterns, const CompileOptions& opts){
+    return Matcher(patterns, opts);
+}
+
+std::vector<std::vector<std::string>> required_literals(const std::vector<std::string>& patterns,
+                                                        const CompileOptions& opts){
+    std::vector<std::vector<std::string>> out;
+    out.reserve(patterns.size());
+    for (const auto& p : patterns){
+        if (opts.fixed_strings){
+            out.push_back(p.empty() ? std::vector<std::string>{} : std::vector<std::string>{p});
+            continue;
+        }
+        RegexOptions ropts;
+        ropts.step_budget = opts.step_budget;
+        ropts.ignore_case = opts.ignore_case;
+        out.push_back(::required_literals(Regex(p, ropts)));
+    }
+    return out;
+}
+
+size_t Scanner::next(size_t from, ScanStats* stats){
+    size_t best = std::string_view::npos;
+    for (int e = 0; e < 3; ++e){
+        size_t& hit = hit_[e];
+        // a cached hit at or after `from` is still the first one from here
+        if (hit == kUnknown || (hit != std::string_view::npos && hit < from)){
+            switch (e){
+                case 0: hit = set_.literals_ ? set_.literals_->scan(buf_, from) : std::string_view::npos; break;
+                case 1: hit = set_.regex_ ? set_.regex_->scan(buf_, from, stats) : std::string_view::npos; break;
+                case 2: hit = set_.backref_ ? set_.backref_->scan(buf_, from, stats) : std::string_view::npos; break;
+            }
+        }
+        best = std::min(best, hit);
+    }
+    return best;
+}
+
+std::optional<Span> Scanner::next_line(ScanStats* stats){
+    if (pos_ > buf_.size()) return std::nullopt;
+    size_t hit = next(pos_, stats);
+    if (hit == std::string_view::npos){
+        pos_ = buf_.size() + 1;
+        return std::nullopt;
+    }
+    Span m = line_at(buf_, pos_, hit);
+    pos_ = m.end + 1;
+    return m;
+}
+
+std::optional<Span> Matches::next(ScanStats* stats){
+    if (pos_ > line_.size()) return std::nullopt;
+    std::optional<Span> best;
+    for (int e = 0; e < 3; ++e){
+        // a kept match starting at or after pos_ is still the leftmost one
+        if (state_[e] == Hit::Unknown || (state_[e] == Hit::Have && hit_[e].begin < pos_)){
+            bool found = false;
+            switch (e){
+                case 0: found = set_.literals_ && set_.literals_->find(line_, pos_, longest_, hit_[e]); break;
+                case 1: found = set_.regex_ && set_.regex_->find(line_, pos_, longest_, hit_[e], stats); break;
+                case 2: found = set_.backref_ && set_.backref_->find(line_, pos_, longest_, hit_[e], stats); break;
+            }
+            state_[e] = found ? Hit::Have : Hit::None;
+        }
+        if (state_[e] != Hit::Have) continue;
+        const Span& h = hit_[e];
+        if (!best || h.begin < best->begin || (h.begin == best->begin && h.end > best->end)) best = h;
+    }
+    if (!best) pos_ = line_.size() + 1;
+    else pos_ = best->end > best->begin ? best->end : best->end + 1;
+    return best;
+}
+
+} // namespace grepcore
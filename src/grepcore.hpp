@@ -0,0 +1,179 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class PatternSet;
+
+// grepcore: the matching engine behind the grep CLI, as a library.
+//
+//   grepcore::Matcher m = grepcore::compile("ERROR (\\d+)");
+//   if (auto hit = m.find(buffer)) ... buffer.substr(hit->begin, hit->end - hit->begin)
+//
+// Input is never copied: lines and buffers are taken as std::string_view or
+// raw byte spans, and matches come back as offsets into them. Nothing here
+// touches iostreams. A Matcher is immutable once compiled and can be used
+// from any number of threads at once; each thread keeps its own scratch
+// state (DFA cache, backtracking stack), allocated on first use and reused.
+namespace grepcore {
+
+// Counters a Scanner fills in when asked for them.
+struct ScanStats {
+    uint64_t candidates = 0;     // lines the literal prefilter let through
+    uint64_t rejected = 0;       // ...that the regex engine then rejected
+    uint64_t lines_skipped = 0;  // lines the engine never had to look at
+    uint64_t gave_up = 0;        // lines that ran out of backtracking budget
+
+    ScanStats& operator+=(const ScanStats& o){
+        candidates += o.candidates;
+        rejected += o.rejected;
+        lines_skipped += o.lines_skipped;
+        gave_up += o.gave_up;
+        return *this;
+    }
+};
+
+// Work done inside the engines, summed over every thread (for --stats).
+// Threads count into blocks of their own without locking; the totals are
+// exact once the threads that search are idle. They cover every Matcher
+// of the process.
+struct EngineCounters {
+    uint64_t starts = 0;       // start offsets the PikeVm and backtracker tried
+    uint64_t steps = 0;        // backtracking steps
+    uint64_t dfa_states = 0;   // DFA states built, in every thread's cache
+    uint64_t dfa_flushes = 0;  // DFA caches thrown away for growing too big
+};
+
+EngineCounters engine_counters();
+
+// One engine a Matcher runs (for --stats): which, for which of its
+// patterns, and the literal it looks for before running, if any.
+struct EnginePlan {
+    std::string engine;            // "aho-corasick", "literal", "dfa", "backtrack" or "empty"
+    std::vector<size_t> patterns;  // indices into the patterns compiled
+    std::string prefilter;
+};
+
+// Which match is reported when several start at the same leftmost offset:
+// the longest (POSIX, grep -E), or the one a backtracking matcher tries
+// first (Perl). Whether a line matches is the same either way.
+enum class MatchKind { LeftmostLongest, LeftmostFirst };
+
+struct CompileOptions {
+    bool fixed_strings = false;  // patterns are literal strings (grep -F)
+    bool ignore_case = false;    // ASCII letters match in either case (grep -i)
+    MatchKind match_kind = MatchKind::LeftmostLongest;
+    // backtracking steps allowed per line before the line is given up on and
+    // counted as not matching; 0 = unlimited
+    uint64_t step_budget = 10'000'000;
+};
+
+// [begin, end) offsets: a match, or a matching line without its '\n'
+struct Span {
+    size_t begin;
+    size_t end;
+};
+
+using Bytes = std::span<const std::byte>;
+
+class Matcher {
+public:
+    // Any of `patterns` matches (grep -e P1 -e P2). Throws std::runtime_error
+    // when a pattern is malformed.
+    explicit Matcher(const std::vector<std::string>& patterns, const CompileOptions& opts = {});
+    explicit Matcher(std::string_view pattern, const CompileOptions& opts = {});
+    ~Matcher();
+    Matcher(Matcher&&) noexcept;
+    Matcher& operator=(Matcher&&) noexcept;
+
+    // whether one line (without its '\n') matches
+    bool match(std::string_view line) const;
+    bool match(Bytes line) const;
+
+    // first matching line of a buffer of '\n'-separated lines, starting with
+    // the line that begins at `from`
+    std::optional<Span> find(std::string_view buf, size_t from = 0) const;
+    std::optional<Span> find(Bytes buf, size_t from = 0) const;
+
+    // the leftmost match in one line starting at or after `from`; see
+    // Matches for all of them
+    std::optional<Span> find_match(std::string_view line, size_t from = 0) const;
+
+    // the engines the patterns were split over, in the order Scanner runs them
+    std::vector<EnginePlan> plan() const;
+
+private:
+    friend class Scanner;
+    friend class Matches;
+    std::unique_ptr<PatternSet> set_;
+    MatchKind kind_;
+};
+
+Matcher compile(std::string_view pattern, const CompileOptions& opts = {});
+Matcher compile(const std::vector<std::string>& patterns, const CompileOptions& opts = {});
+
+// Literal strings a line must contain to match, per pattern: no line
+// without every string of result[k] can match patterns[k]. An empty list
+// means the pattern promises nothing. Throws like Matcher on a malformed
+// pattern. For narrowing down what to read at all, e.g. with an index.
+std::vector<std::vector<std::string>> required_literals(const std::vector<std::string>& patterns,
+                                                        const CompileOptions& opts = {});
+
+// Forward-only search for every matching line of one buffer. Each engine
+// remembers where its next hit is, so however the hits of the patterns
+// interleave the buffer is read once per engine. Cheap to make: one per
+// buffer and thread.
+class Scanner {
+public:
+    Scanner(const Matcher& m, std::string_view buf) : set_(*m.set_), buf_(buf) {}
+    Scanner(const Matcher& m, Bytes buf)
+        : Scanner(m, std::string_view(reinterpret_cast<const char*>(buf.data()), buf.size())) {}
+
+    // An offset inside the first matching line at or after the line starting
+    // at `from`, or npos; `from` must not go backwards. This is the cheap
+    // form: the line's bounds are left to the caller to find if needed.
+    size_t next(size_t from, ScanStats* stats = nullptr);
+
+    // the next matching line after the one returned before
+    std::optional<Span> next_line(ScanStats* stats = nullptr);
+
+private:
+    static constexpr size_t kUnknown = std::string_view::npos - 1;
+
+    const PatternSet& set_;
+    std::string_view buf_;
+    size_t pos_ = 0;                                     // for next_line()
+    size_t hit_[3] = {kUnknown, kUnknown, kUnknown};     // per engine, npos = none left
+};
+
+// Every non-overlapping match in one line (without its '\n'), left to right,
+// found in a single pass: each engine's next match is kept until the search
+// position moves past its start. After an empty match the search resumes
+// one byte further on. When two engines' matches start at the same offset
+// the longer one is taken, whatever the MatchKind.
+//
+//   for (grepcore::Matches ms(m, line); auto sp = ms.next(); ) ...
+class Matches {
+public:
+    Matches(const Matcher& m, std::string_view line, size_t from = 0)
+        : set_(*m.set_), line_(line), longest_(m.kind_ == MatchKind::LeftmostLongest), pos_(from) {}
+
+    std::optional<Span> next(ScanStats* stats = nullptr);
+
+private:
+    enum class Hit : uint8_t { Unknown, None, Have };
+
+    const PatternSet& set_;
+    std::string_view line_;
+    bool longest_;
+    size_t pos_;                                           // past line_ when done
+    Span hit_[3] = {};                                     // per engine
+    Hit state_[3] = {Hit::Unknown, Hit::Unknown, Hit::Unknown};
+};
+
+} // namespace grepcore
@@ -0,0 +1,423 @@
+#include "index.hpp"
+#include "diag.hpp"
+#include "input.hpp"
+#include "thread_pool.hpp"
+#include "walk.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kMagic[8] = {'G', 'R', 'E', 'P', 'I', 'D', 'X', '1'};
+static constexpr uint32_t kBinary = 1;     // FileEntry::flags: not indexed, a NUL early on
+static constexpr uint32_t kCompressed = 2; // indexed as -z decoded it
+static constexpr uint32_t kNone = UINT32_MAX;
+static constexpr uint32_t kTrigrams = 1 << 24;
+
+struct TrigramIndex::Header {
+    char magic[8];
+    uint32_t nfiles;
+    uint32_t ntrigrams;
+    uint64_t files_off;
+    uint64_t paths_off;
+    uint64_t trigrams_off;
+    uint64_t postings_off;
+    uint64_t size;          // of the whole file
+};
+
+struct TrigramIndex::FileEntry {
+    uint64_t path_off;      // into the path bytes
+    uint32_t path_len;
+    uint32_t flags;
+    int64_t mtime_ns;
+    uint64_t size;
+};
+
+struct TrigramIndex::TrigramEntry {
+    uint32_t trigram;
+    uint32_t count;         // files that have it
+    uint64_t off;           // of its postings, from postings_off
+};
+
+static std::string dir_prefix(const std::string& root){
+    return root.empty() || root.back() == '/' ? root : root + '/';
+}
+
+static std::string index_path(const std::string& root){
+    return dir_prefix(root) + TrigramIndex::kFileName;
+}
+
+// the index itself (or the one being written), at the top of the tree
+static bool is_index_file(std::string_view rel){
+    return rel.starts_with(TrigramIndex::kFileName) && rel.find('/') == std::string_view::npos;
+}
+
+static int64_t mtime_ns(const struct stat& st){
+    return int64_t(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+}
+
+static unsigned char fold(unsigned char c){
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static void put_varint(std::string& out, uint32_t v){
+    while (v >= 0x80){ out += char(v | 0x80); v >>= 7; }
+    out += char(v);
+}
+
+// The distinct trigrams of one file, collected in a bitmap over all 2^24 of
+// them; only the bits that were set are cleared again afterwards.
+namespace {
+
+struct TrigramSet {
+    std::vector<uint64_t> bits = std::vector<uint64_t>(kTrigrams / 64);
+    std::vector<uint32_t> seen;
+
+    void add(std::string_view text){
+        uint32_t key = 0;
+        int have = 0;
+        for (unsigned char c : text){
+            if (c == '\n'){ have = 0; continue; }
+            key = ((key << 8) | fold(c)) & (kTrigrams - 1);
+            if (++have < 3) continue;
+            uint64_t& word = bits[key / 64];
+            uint64_t mask = uint64_t(1) << (key % 64);
+            if (!(word & mask)){ word |= mask; seen.push_back(key); }
+        }
+    }
+
+    std::vector<uint32_t> take(){
+        for (uint32_t key : seen) bits[key / 64] = 0;
+        std::vector<uint32_t> out;
+        out.swap(seen);
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+};
+
+TrigramSet& trigram_set(){
+    thread_local TrigramSet s;
+    return s;
+}
+
+// one file found by the walk of a build
+struct Indexed {
+    std::string rel;
+    int64_t mtime_ns = 0;
+    uint64_t size = 0;
+    uint32_t flags = 0;
+    uint32_t old_id = kNone;         // unchanged since the previous index
+    bool dropped = false;            // vanished or unreadable
+    std::vector<uint32_t> trigrams;  // sorted, when read
+};
+
+} // namespace
+
+TrigramIndex::TrigramIndex(const std::string& root, const Options& opt)
+    : prefix_(dir_prefix(root)), search_binary_(opt.text), decompress_(opt.decompress) {
+    const std::string path = index_path(root);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        throw std::runtime_error(path + ": " + std::system_category().message(errno) +
+                                 " (build it with --index-build " + root + ")");
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(Header)){
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED){
+            map_ = static_cast<const char*>(p);
+            size_ = st.st_size;
+        }
+    }
+    ::close(fd);
+
+    auto damaged = [&]{
+        return std::runtime_error(path + ": damaged index (rebuild it with --index-build " + root + ")");
+    };
+    if (!map_) throw damaged();
+    Header h;
+    std::memcpy(&h, map_, sizeof h);
+    const bool ok = std::memcmp(h.magic, kMagic, sizeof kMagic) == 0 && h.size == size_ &&
+        h.files_off + uint64_t(h.nfiles) * sizeof(FileEntry) <= h.paths_off &&
+        h.paths_off <= h.trigrams_off &&
+        h.trigrams_off + uint64_t(h.ntrigrams) * sizeof(TrigramEntry) <= h.postings_off &&
+        h.postings_off <= size_ && h.files_off % 8 == 0 && h.trigrams_off % 8 == 0;
+    if (!ok){
+        munmap(const_cast<char*>(map_), size_);
+        map_ = nullptr;
+        throw damaged();
+    }
+    files_ = reinterpret_cast<const FileEntry*>(map_ + h.files_off);
+    nfiles_ = h.nfiles;
+    paths_ = map_ + h.paths_off;
+    trigrams_ = reinterpret_cast<const TrigramEntry*>(map_ + h.trigrams_off);
+    ntrigrams_ = h.ntrigrams;
+    postings_ = reinterpret_cast<const unsigned char*>(map_ + h.postings_off);
+}
+
+TrigramIndex::~TrigramIndex(){
+    if (map_) munmap(const_cast<char*>(map_), size_);
+}
+
+std::string_view TrigramIndex::path_of(const FileEntry& f) const {
+    const char* end = map_ + size_;
+    if (f.path_off > size_t(end - paths_) || f.path_len > size_t(end - paths_) - f.path_off) return {};
+    return std::string_view(paths_ + f.path_off, f.path_len);
+}
+
+const TrigramIndex::FileEntry* TrigramIndex::find(std::string_view rel) const {
+    const FileEntry* end = files_ + nfiles_;
+    const FileEntry* it = std::lower_bound(files_, end, rel, [&](const FileEntry& f, std::string_view r){
+        return path_of(f) < r;
+    });
+    return it != end && path_of(*it) == rel ? it : nullptr;
+}
+
+const TrigramIndex::TrigramEntry* TrigramIndex::lookup(uint32_t trigram) const {
+    const TrigramEntry* end = trigrams_ + ntrigrams_;
+    const TrigramEntry* it = std::lower_bound(trigrams_, end, trigram, [](const TrigramEntry& t, uint32_t k){
+        return t.trigram < k;
+    });
+    return it != end && it->trigram == trigram ? it : nullptr;
+}
+
+// decoded file ids; a list running past the end of the file is cut short
+std::vector<uint32_t> TrigramIndex::postings(const TrigramEntry& t) const {
+    std::vector<uint32_t> ids;
+    ids.reserve(t.count);
+    const unsigned char* p = postings_ + t.off;
+    const unsigned char* end = reinterpret_cast<const unsigned char*>(map_ + size_);
+    uint32_t id = 0;
+    for (uint32_t k = 0; k < t.count && p < end; ++k){
+        uint32_t delta = 0;
+        for (int shift = 0; p < end && shift < 35; shift += 7){
+            unsigned char b = *p++;
+            delta |= uint32_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+        }
+        id += delta;
+        if (id >= nfiles_) break;
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+// Per pattern, the files holding every trigram of its factors (rarest
+// trigram first, so the running intersection is small from the start);
+// the candidates are the union of those.
+void TrigramIndex::restrict(const std::vector<std::vector<std::string>>& factors){
+    candidate_.assign(nfiles_, false);
+    for (const auto& pattern : factors){
+        std::vector<uint32_t> keys;
+        for (const auto& f : pattern){
+            for (size_t i = 0; i + 3 <= f.size(); ++i){
+                keys.push_back(uint32_t(fold(f[i])) << 16 | uint32_t(fold(f[i + 1])) << 8 | fold(f[i + 2]));
+            }
+        }
+        if (keys.empty()){
+            candidate_.clear(); // this pattern can match anywhere
+            return;
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        std::vector<const TrigramEntry*> entries;
+        for (uint32_t k : keys){
+            const TrigramEntry* t = lookup(k);
+            if (!t){ entries.clear(); break; } // no file has it
+            entries.push_back(t);
+        }
+        if (entries.empty()) continue;
+        std::sort(entries.begin(), entries.end(), [](auto a, auto b){ return a->count < b->count; });
+
+        std::vector<uint32_t> ids = postings(*entries[0]);
+        for (size_t k = 1; k < entries.size() && !ids.empty(); ++k){
+            std::vector<uint32_t> other = postings(*entries[k]), both;
+            std::set_intersection(ids.begin(), ids.end(), other.begin(), other.end(),
+                                  std::back_inserter(both));
+            ids.swap(both);
+        }
+        for (uint32_t id : ids) candidate_[id] = true;
+    }
+}
+
+TrigramIndex::Verdict TrigramIndex::check(const std::string& path) const {
+    if (path.compare(0, prefix_.size(), prefix_) != 0) return Verdict::Search;
+    std::string_view rel = std::string_view(path).substr(prefix_.size());
+    if (is_index_file(rel)) return Verdict::Skip;
+    const FileEntry* f = find(rel);
+    if (!f) return Verdict::Search; // new since the index was built
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return Verdict::Search; // let opening it report why
+    if (mtime_ns(st) != f->mtime_ns || uint64_t(st.st_size) != f->size) return Verdict::Search;
+    // trigrams of one form of the file say nothing about the other
+    if ((f->flags & kCompressed) && !decompress_) return Verdict::Search;
+    if (f->flags & kBinary){
+        return search_binary_ || decompress_ ? Verdict::Search : Verdict::Skip;
+    }
+    return candidate_.empty() || candidate_[f - files_] ? Verdict::Search : Verdict::NoMatch;
+}
+
+// Walk the tree as -r would and index every file on the pool: unchanged
+// ones are looked up in the previous index, the rest are read. The new
+// index is written next to the old one and renamed over it, so a search
+// running meanwhile sees one or the other.
+TrigramIndex::BuildStats TrigramIndex::build(const std::string& root, const Options& opt){
+    const Walker walker(opt);
+    auto top = walker.root(root);
+    if (!top) throw std::runtime_error(root + ": not a directory");
+
+    std::unique_ptr<TrigramIndex> old;
+    try { old = std::make_unique<TrigramIndex>(root, opt); }
+    catch (const std::runtime_error&) {} // none yet, or not usable: index everything
+
+    const std::string prefix = dir_prefix(root);
+    std::deque<Indexed> found;
+    ThreadPool pool(opt.jobs);
+
+    auto index_file = [&old, &opt](const std::string& path, const Walker::DirFdPtr& at, Indexed* f){
+        const char* name = Walker::base_name(path);
+        struct stat st;
+        if (::fstatat(at->fd(), name, &st, 0) != 0){ f->dropped = true; return; }
+        f->mtime_ns = mtime_ns(st);
+        f->size = st.st_size;
+        if (old){
+            const FileEntry* e = old->find(f->rel);
+            if (e && e->mtime_ns == f->mtime_ns && e->size == f->size){
+                f->old_id = static_cast<uint32_t>(e - old->files_);
+                f->flags = e->flags;
+                return;
+            }
+        }
+        auto in = Input::open(at->fd(), name);
+        if (!in){
+            report(path, std::system_category().message(errno));
+            f->dropped = true;
+            return;
+        }
+        if (opt.decompress){
+            if (!in->decode()){ f->flags |= kBinary; return; } // can't be read here either
+            if (in->format() != Decompressor::Format::None) f->flags |= kCompressed;
+        }
+        if (in->binary()){ f->flags |= kBinary; return; }
+        TrigramSet& set = trigram_set();
+        std::string_view chunk;
+        while (in->next(chunk)) set.add(chunk);
+        f->trigrams = set.take();
+    };
+
+    Walker::FileFn on_file = [&](std::string path, const Walker::DirFdPtr& at){
+        std::string_view rel = std::string_view(path).substr(prefix.size());
+        if (is_index_file(rel)) return;
+        Indexed* f = &found.emplace_back();
+        f->rel = rel;
+        pool.submit([&index_file, path = std::move(path), at, f]{ index_file(path, at, f); });
+    };
+    Walker::DirFn descend = [&](const Walker::DirPtr& dir, const Walker::DirFdPtr& at){
+        walker.list(dir, at, on_file, descend);
+    };
+    descend(top, nullptr);
+    pool.wait();
+
+    // file ids in path order, for find()
+    std::vector<Indexed*> files;
+    for (auto& f : found){
+        if (!f.dropped) files.push_back(&f);
+    }
+    std::sort(files.begin(), files.end(), [](auto a, auto b){ return a->rel < b->rel; });
+    if (files.size() >= kNone) throw std::runtime_error(root + ": too many files to index");
+
+    BuildStats stats;
+    stats.files = files.size();
+
+    // (trigram, file id) pairs, from the old postings and from what was read
+    std::vector<uint64_t> pairs;
+    std::vector<uint32_t> renumber(old ? old->nfiles_ : 0, kNone);
+    for (uint32_t id = 0; id < files.size(); ++id){
+        const Indexed& f = *files[id];
+        if (f.old_id != kNone){
+            renumber[f.old_id] = id;
+            ++stats.unchanged;
+            continue;
+        }
+        if (!(f.flags & kBinary)) stats.bytes += f.size;
+        for (uint32_t t : f.trigrams) pairs.push_back(uint64_t(t) << 32 | id);
+    }
+    if (stats.unchanged){
+        for (uint32_t k = 0; k < old->ntrigrams_; ++k){
+            const TrigramEntry& t = old->trigrams_[k];
+            for (uint32_t id : old->postings(t)){
+                if (renumber[id] != kNone) pairs.push_back(uint64_t(t.trigram) << 32 | renumber[id]);
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    std::vector<TrigramEntry> trigrams;
+    std::string postings;
+    for (size_t i = 0; i < pairs.size(); ){
+        TrigramEntry t{uint32_t(pairs[i] >> 32), 0, postings.size()};
+        uint32_t last = 0;
+        for (; i < pairs.size() && uint32_t(pairs[i] >> 32) == t.trigram; ++i){
+            uint32_t id = uint32_t(pairs[i]);
+            put_varint(postings, id - last);
+            last = id;
+            ++t.count;
+        }
+        trigrams.push_back(t);
+    }
+    std::vector<uint64_t>().swap(pairs);
+    stats.trigrams = trigrams.size();
+
+    std::vector<FileEntry> entries;
+    std::string paths;
+    for (const Indexed* f : files){
+        entries.push_back({paths.size(), uint32_t(f->rel.size()), f->flags, f->mtime_ns, f->size});
+        paths += f->rel;
+    }
+    paths.resize((paths.size() + 7) & ~size_t(7));
+
+    Header h;
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.nfiles = uint32_t(entries.size());
+    h.ntrigrams = uint32_t(trigrams.size());
+    h.files_off = sizeof(Header);
+    h.paths_off = h.files_off + entries.size() * sizeof(FileEntry);
+    h.trigrams_off = h.paths_off + paths.size();
+    h.postings_off = h.trigrams_off + trigrams.size() * sizeof(TrigramEntry);
+    h.size = h.postings_off + postings.size();
+
+    old.reset();
+    const std::string path = index_path(root), tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&h), sizeof h);
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(FileEntry));
+        out.write(paths.data(), paths.size());
+        out.write(reinterpret_cast<const char*>(trigrams.data()), trigrams.size() * sizeof(TrigramEntry));
+        out.write(postings.data(), postings.size());
+        out.close();
+        if (!out){
+            std::string why = std::system_category().message(errno);
+            std::remove(tmp.c_str());
+            throw std::runtime_error(path + ": cannot write index: " + why);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0){
+        std::string why = std::system_category().message(errno);
+        std::remove(tmp.c_str());
+        throw std::runtime_error(path + ": cannot write index: " + why);
+    }
+    return stats;
+}
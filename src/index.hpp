@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "options.hpp"
+
+// Trigram index of a directory tree, for searching the same large tree over
+// and over (--index-build DIR, then --index DIR).
+//
+// The index is one file, DIR/.grep-index, mmapped as it is:
+//
+//   Header
+//   FileEntry[nfiles]        sorted by path below DIR
+//   path bytes
+//   TrigramEntry[ntrigrams]  sorted by trigram
+//   postings                 per trigram, the ids of the files that contain
+//                            it as varint deltas, ascending
+//
+// Trigrams are three bytes within a line, ASCII letters folded to lower
+// case. A search turns the literal factors of every pattern into trigrams:
+// a file can only hold a match of a pattern if it has all of the trigrams
+// of that pattern's factors. Files the index doesn't know, or whose size or
+// mtime changed since it was built, are searched regardless. With -z,
+// compressed files are indexed by their decoded contents.
+class TrigramIndex {
+public:
+    static constexpr const char* kFileName = ".grep-index";
+
+    struct BuildStats {
+        size_t files = 0;       // in the index
+        size_t unchanged = 0;   // ...taken over from the previous one unread
+        uint64_t bytes = 0;     // read to index the others
+        size_t trigrams = 0;
+    };
+
+    // Index the files -r would search under `root`, with opt's filters.
+    // Files whose size and mtime match the previous index keep their
+    // entries without being read again. Throws std::runtime_error if the
+    // index can't be written.
+    static BuildStats build(const std::string& root, const Options& opt);
+
+    // the index of `root`; throws std::runtime_error if there is none or it
+    // is damaged
+    TrigramIndex(const std::string& root, const Options& opt);
+    ~TrigramIndex();
+    TrigramIndex(const TrigramIndex&) = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+    // Narrow the candidates down to the files that may match one of the
+    // patterns, given as grepcore::required_literals() returns them.
+    void restrict(const std::vector<std::vector<std::string>>& factors);
+
+    // What to do with a file the walk of `root` found: read it; count it
+    // as searched without a match; or leave it out, as -r would (the index
+    // itself, and binary files without -a)
+    enum class Verdict { Search, NoMatch, Skip };
+    Verdict check(const std::string& path) const;
+
+private:
+    struct Header;
+    struct FileEntry;
+    struct TrigramEntry;
+
+    std::string_view path_of(const FileEntry& f) const;
+    const FileEntry* find(std::string_view rel) const;
+    const TrigramEntry* lookup(uint32_t trigram) const;
+    std::vector<uint32_t> postings(const TrigramEntry& t) const;
+
+    std::string prefix_;        // root with a trailing '/'
+    bool search_binary_;        // -a: binary files have no trigrams but are searched
+    bool decompress_;           // -z: and so may be compressed ones indexed without it
+    const char* map_ = nullptr;
+    size_t size_ = 0;
+    const FileEntry* files_ = nullptr;
+    uint32_t nfiles_ = 0;
+    const TrigramEntry* trigrams_ = nullptr;
+    uint32_t ntrigrams_ = 0;
+    const unsigned char* postings_ = nullptr;
+    const char* paths_ = nullptr;
+    std::vector<bool> candidate_; // per file id; empty = all of them
+};
@@ -0,0 +1,143 @@
+#include "input.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr size_t kPageAlign = 4096;
+
+std::unique_ptr<Input> Input::open(const char* path){
+    return open(AT_FDCWD, path);
+}
+
+std::unique_ptr<Input> Input::open(int dir_fd, const char* name){
+    int fd = ::openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    return std::make_unique<Input>(fd, true);
+}
+
+Input::Input(int fd, bool owns_fd) : fd_(fd), owns_fd_(owns_fd) {
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (p != MAP_FAILED){
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            map_ = static_cast<const char*>(p);
+            map_size_ = st.st_size;
+        }
+    }
+}
+
+Input::~Input(){
+    decoder_.reset(); // its thread may still be reading the mapping or fd_
+    if (map_) munmap(const_cast<char*>(map_), map_size_);
+    std::free(buf_);
+    if (owns_fd_) ::close(fd_);
+}
+
+// Read once more into the tail of the buffer, growing it when it is full.
+// A single read() per call keeps interactive pipes responsive.
+bool Input::fill(){
+    if (len_ == cap_){
+        size_t cap = cap_ ? cap_ * 2 : kBlockSize;
+        char* grown = static_cast<char*>(std::aligned_alloc(kPageAlign, cap));
+        if (!grown) throw std::bad_alloc();
+        if (len_) std::memcpy(grown, buf_, len_);
+        std::free(buf_);
+        buf_ = grown;
+        cap_ = cap;
+    }
+    for (;;){
+        ssize_t n = decoder_ ? decoder_->read(buf_ + len_, cap_ - len_)
+                             : ::read(fd_, buf_ + len_, cap_ - len_);
+        if (n > 0){ len_ += n; return true; }
+        if (n == 0){ eof_ = true; return false; }
+        if (errno == EINTR) continue;
+        eof_ = true; // treat read errors like EOF, as getline did
+        return false;
+    }
+}
+
+bool Input::decode(){
+    std::string_view head;
+    if (mapped()) head = std::string_view(map_, std::min<size_t>(map_size_, 8));
+    else {
+        while (len_ < 8 && !eof_ && fill()) {}
+        head = std::string_view(buf_, len_);
+    }
+    format_ = Decompressor::sniff(head);
+    if (format_ == Decompressor::Format::None) return true;
+    if (!Decompressor::supported(format_)){
+        error_ = std::string(Decompressor::name(format_)) + ": not supported by this build";
+        return false;
+    }
+    if (mapped()){
+        decoder_ = std::make_unique<Decompressor>(format_, std::string_view(map_, map_size_));
+    } else {
+        // what was read to sniff the format is compressed input too
+        decoder_ = std::make_unique<Decompressor>(format_, fd_, std::string(buf_, len_));
+        len_ = 0;
+        eof_ = false;
+    }
+    return true;
+}
+
+std::string Input::error() const {
+    return decoder_ ? decoder_->error() : error_;
+}
+
+bool Input::binary(){
+    if (mapped()) return std::memchr(map_, 0, std::min(map_size_, kSniffSize)) != nullptr;
+    if (len_ == 0 && !eof_) fill();
+    return len_ && std::memchr(buf_, 0, std::min(len_, kSniffSize)) != nullptr;
+}
+
+bool Input::next(std::string_view& chunk){
+    if (mapped()){
+        if (map_done_) return false;
+        map_done_ = true;
+        chunk = std::string_view(map_, map_size_);
+        return true;
+    }
+
+    // drop what the caller has seen but the history lines, keep the
+    // partial last line
+    if (handed_){
+        size_t keep = handed_;
+        for (size_t k = 0; k < history_lines_ && keep > 0; ++k){
+            const void* nl = keep > 1 ? memrchr(buf_, '\n', keep - 1) : nullptr;
+            keep = nl ? static_cast<const char*>(nl) - buf_ + 1 : 0;
+        }
+        std::memmove(buf_, buf_ + keep, len_ - keep);
+        len_ -= keep;
+        kept_ = handed_ - keep;
+        handed_ = 0;
+    }
+    while (len_ < batch_ && !eof_ && fill()) {}
+    size_t scanned = kept_;
+    for (;;){
+        if (len_ > scanned){
+            const void* nl = memrchr(buf_ + scanned, '\n', len_ - scanned);
+            if (nl){
+                handed_ = static_cast<const char*>(nl) - buf_ + 1;
+                chunk = std::string_view(buf_ + kept_, handed_ - kept_);
+                return true;
+            }
+            scanned = len_;
+        }
+        if (eof_ || !fill()){
+            if (len_ == kept_) return false;
+            handed_ = len_; // last line without a trailing newline
+            chunk = std::string_view(buf_ + kept_, len_ - kept_);
+            return true;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "decompress.hpp"
+
+// Zero-copy access to one input. Regular files are mmapped and handed out as
+// a single buffer; pipes, terminals and anything that cannot be mapped are
+// read in large page-aligned blocks. Every buffer returned by next() ends on
+// a line boundary (or at EOF), so the matcher can scan it as a run of whole
+// lines without ever copying one out.
+class Input {
+public:
+    static constexpr size_t kBlockSize = 1 << 20;
+
+    // nullptr if the file cannot be opened; with `dir_fd`, `name` is
+    // opened relative to that directory
+    static std::unique_ptr<Input> open(const char* path);
+    static std::unique_ptr<Input> open(int dir_fd, const char* name);
+
+    // wrap an already open descriptor (e.g. stdin); fd is not closed
+    explicit Input(int fd, bool owns_fd = false);
+    ~Input();
+    Input(const Input&) = delete;
+    Input& operator=(const Input&) = delete;
+
+    // next run of whole lines; false once the input is exhausted
+    bool next(std::string_view& chunk);
+
+    // streams only: keep reading until `bytes` are buffered (or EOF) before
+    // handing out a buffer, so a large stdin arrives in pieces big enough to
+    // split across threads
+    void set_batch(size_t bytes) { batch_ = bytes; }
+
+    // Streams: hold on to the last `lines` lines of each buffer handed out,
+    // right in front of the next one, for history() to return (-B). A mapped
+    // file is a single buffer and has none.
+    void set_history(size_t lines) { history_lines_ = lines; }
+    // the whole lines just before the buffer last returned by next()
+    std::string_view history() const { return std::string_view(buf_, kept_); }
+
+    bool mapped() const { return map_ != nullptr && !decoder_; }
+
+    // -z: if the input starts with the magic bytes of a compressed format,
+    // next() hands out the decoded bytes from here on. Call before next()
+    // and binary(). False, with error() set, for a format this build can't
+    // read.
+    bool decode();
+    Decompressor::Format format() const { return format_; }
+    // why the input was cut short, or "" (only decoding reports anything)
+    std::string error() const;
+
+    // Whether the input looks binary, as grep decides it: a NUL byte in the
+    // first kSniffSize bytes. Call before next(); a stream keeps what it
+    // read for it.
+    static constexpr size_t kSniffSize = 32 << 10;
+    bool binary();
+
+private:
+    bool fill();
+
+    int fd_;
+    bool owns_fd_;
+
+    const char* map_ = nullptr;
+    size_t map_size_ = 0;
+    bool map_done_ = false;
+
+    char* buf_ = nullptr;   // page-aligned streaming buffer
+    size_t cap_ = 0;
+    size_t len_ = 0;        // bytes held in buf_
+    size_t handed_ = 0;     // bytes of buf_ already returned by next()
+    size_t batch_ = 0;
+    size_t history_lines_ = 0;
+    size_t kept_ = 0;       // bytes at the start of buf_ kept as history
+    bool eof_ = false;
+
+    Decompressor::Format format_ = Decompressor::Format::None;
+    std::unique_ptr<Decompressor> decoder_;
+    std::string error_;
+};
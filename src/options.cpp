@@ -0,0 +1,173 @@
+#include "options.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <unistd.h>
+
+static const char* kUsage =
+    "Usage: exe [-r|-R] [-j N] [--ordered] [--backtrack-limit=N] [--line-buffered] [--trace=FILE]\n"
+    "           [--stats[=text|json]]\n"
+    "           [-F] [-i] [-c|-l|-q] [-m NUM] [-o] [-b] [-A NUM] [-B NUM] [-C NUM] [--color[=WHEN]]\n"
+    "           [-a] [-z] [--include=GLOB] [--exclude=GLOB] [--exclude-dir=GLOB] [--no-ignore]\n"
+    "           {-E <pattern> | -e <pattern>... | -f FILE} [file...]\n"
+    "       exe --index-build DIR\n"
+    "       exe --index DIR [options] {-E <pattern> | -e <pattern>... | -f FILE}";
+
+static unsigned long parse_count(const std::string& flag, const std::string& value){
+    size_t used = 0;
+    unsigned long n = 0;
+    try { n = std::stoul(value, &used); } catch (const std::exception&) { used = 0; }
+    if (used == 0 || used != value.size()){
+        throw std::runtime_error("invalid number for " + flag + ": '" + value + "'\n" + kUsage);
+    }
+    return n;
+}
+
+// --color's WHEN, with GNU grep's synonyms
+static bool parse_color(const std::string& when){
+    if (when == "always" || when == "yes" || when == "force") return true;
+    if (when == "never" || when == "no" || when == "none") return false;
+    if (when == "auto" || when == "tty" || when == "if-tty"){
+        const char* term = std::getenv("TERM");
+        return isatty(STDOUT_FILENO) && term && std::strcmp(term, "dumb") != 0;
+    }
+    throw std::runtime_error("invalid argument '" + when + "' for --color\n" + kUsage);
+}
+
+// --stats's FORMAT
+static Options::Stats parse_stats(const std::string& format){
+    if (format == "text") return Options::Stats::Text;
+    if (format == "json") return Options::Stats::Json;
+    throw std::runtime_error("invalid argument '" + format + "' for --stats\n" + kUsage);
+}
+
+// like grep, a pattern containing newlines is one pattern per line
+static void add_patterns(Options& opt, const std::string& text){
+    size_t start = 0, nl;
+    while ((nl = text.find('\n', start)) != std::string::npos){
+        opt.patterns.push_back(text.substr(start, nl - start));
+        start = nl + 1;
+    }
+    opt.patterns.push_back(text.substr(start));
+}
+
+static void read_patterns(Options& opt, const std::string& path){
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot read patterns from " + path);
+    std::string line;
+    while (std::getline(in, line)) opt.patterns.push_back(line);
+}
+
+Options parse_options(int argc, char* argv[]){
+    Options opt;
+    bool have_pattern = false;
+    bool only_paths = false;
+    std::vector<std::string> args;
+
+    auto value_of = [&](int& i, const std::string& flag) -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error("option " + flag + " needs a value\n" + kUsage);
+        return argv[++i];
+    };
+
+    for (int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if (only_paths || arg.size() < 2 || arg[0] != '-') args.push_back(arg);
+        else if (arg == "--") only_paths = true;
+        else if (arg == "-E" || arg == "-e"){
+            // the argument after -E / -e is always a pattern, even if it
+            // looks like an option
+            add_patterns(opt, value_of(i, arg));
+            have_pattern = true;
+        }
+        else if (arg == "-f"){ read_patterns(opt, value_of(i, arg)); have_pattern = true; }
+        else if (arg == "-F") opt.fixed_strings = true;
+        else if (arg == "-i" || arg == "--ignore-case") opt.ignore_case = true;
+        else if (arg == "-c" || arg == "--count") opt.count = true;
+        else if (arg == "-l" || arg == "--files-with-matches") opt.files_with_matches = true;
+        else if (arg == "-q" || arg == "--quiet" || arg == "--silent") opt.quiet = true;
+        else if (arg == "-m") opt.max_count = parse_count(arg, value_of(i, arg));
+        else if (arg.rfind("--max-count=", 0) == 0) opt.max_count = parse_count("--max-count", arg.substr(12));
+        else if (arg.rfind("-m", 0) == 0) opt.max_count = parse_count("-m", arg.substr(2));
+        else if (arg == "-o" || arg == "--only-matching") opt.only_matching = true;
+        else if (arg == "-b" || arg == "--byte-offset") opt.byte_offset = true;
+        else if (arg.size() >= 2 && (arg[1] == 'A' || arg[1] == 'B' || arg[1] == 'C')){
+            // -A NUM, -ANUM; -C sets both
+            uint64_t n = parse_count(arg.substr(0, 2), arg.size() > 2 ? arg.substr(2) : value_of(i, arg));
+            if (arg[1] != 'B') opt.after_context = n;
+            if (arg[1] != 'A') opt.before_context = n;
+            opt.context = true;
+        }
+        else if (arg.rfind("--after-context=", 0) == 0){
+            opt.after_context = parse_count("--after-context", arg.substr(16));
+            opt.context = true;
+        }
+        else if (arg.rfind("--before-context=", 0) == 0){
+            opt.before_context = parse_count("--before-context", arg.substr(17));
+            opt.context = true;
+        }
+        else if (arg.rfind("--context=", 0) == 0){
+            opt.after_context = opt.before_context = parse_count("--context", arg.substr(10));
+            opt.context = true;
+        }
+        else if (arg == "--color" || arg == "--colour") opt.color = parse_color("auto");
+        else if (arg.rfind("--color=", 0) == 0 || arg.rfind("--colour=", 0) == 0)
+            opt.color = parse_color(arg.substr(arg.find('=') + 1));
+        else if (arg == "-r") opt.recursive = true;
+        else if (arg == "-R"){ opt.recursive = true; opt.dereference = true; }
+        else if (arg == "--include" || arg == "--exclude" || arg == "--exclude-dir"){
+            (arg == "--include" ? opt.include : arg == "--exclude" ? opt.exclude : opt.exclude_dir)
+                .push_back(value_of(i, arg));
+        }
+        else if (arg.rfind("--include=", 0) == 0) opt.include.push_back(arg.substr(10));
+        else if (arg.rfind("--exclude=", 0) == 0) opt.exclude.push_back(arg.substr(10));
+        else if (arg.rfind("--exclude-dir=", 0) == 0) opt.exclude_dir.push_back(arg.substr(14));
+        else if (arg == "--no-ignore") opt.no_ignore = true;
+        else if (arg == "-a" || arg == "--text") opt.text = true;
+        else if (arg == "-z" || arg == "--decompress") opt.decompress = true;
+        else if (arg == "--index-build") opt.index_build = value_of(i, arg);
+        else if (arg.rfind("--index-build=", 0) == 0) opt.index_build = arg.substr(14);
+        else if (arg == "--index") opt.index = value_of(i, arg);
+        else if (arg.rfind("--index=", 0) == 0) opt.index = arg.substr(8);
+        else if (arg == "-j") opt.jobs = parse_count(arg, value_of(i, arg));
+        else if (arg.rfind("-j", 0) == 0) opt.jobs = parse_count("-j", arg.substr(2));
+        else if (arg.rfind("--jobs=", 0) == 0) opt.jobs = parse_count("--jobs", arg.substr(7));
+        else if (arg == "--ordered") opt.ordered = true;
+        else if (arg == "--backtrack-limit") opt.backtrack_limit = parse_count(arg, value_of(i, arg));
+        else if (arg.rfind("--backtrack-limit=", 0) == 0)
+            opt.backtrack_limit = parse_count("--backtrack-limit", arg.substr(18));
+        else if (arg == "--line-buffered") opt.line_buffered = true;
+        else if (arg == "--stats") opt.stats = Options::Stats::Text;
+        else if (arg.rfind("--stats=", 0) == 0) opt.stats = parse_stats(arg.substr(8));
+        else if (arg == "--trace") opt.trace_file = value_of(i, arg);
+        else if (arg.rfind("--trace=", 0) == 0) opt.trace_file = arg.substr(8);
+        else throw std::runtime_error("unknown option " + arg + "\n" + kUsage);
+    }
+
+    if (opt.jobs == 0) opt.jobs = std::max(1u, std::thread::hardware_concurrency());
+    if (!opt.index_build.empty()){
+        if (have_pattern || !args.empty()){
+            throw std::runtime_error(std::string("--index-build takes no pattern or files\n") + kUsage);
+        }
+        return opt;
+    }
+
+    size_t k = 0;
+    if (!have_pattern){
+        if (args.empty()) throw std::runtime_error(kUsage);
+        add_patterns(opt, args[k++]);
+    }
+    opt.paths.assign(args.begin() + k, args.end());
+    if (!opt.index.empty()){
+        // the index covers one tree, which is what gets searched
+        if (!opt.paths.empty()){
+            throw std::runtime_error(std::string("--index searches DIR only, not other files\n") + kUsage);
+        }
+        opt.recursive = true;
+        opt.paths.push_back(opt.index);
+    }
+    return opt;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Command line of the grep executable.
+//
+//   exe -E <pattern> [file...]
+//   exe -r|-R [-j N] [--ordered] -E <pattern> [dir|file...]
+//   exe [-F] -e <pattern> [-e <pattern>...] [-f FILE] [file...]
+//   exe --index-build DIR
+//   exe --index DIR [-j N] -E <pattern>
+//
+//   -e/-f add patterns (one per line of FILE); a line matches if any does.
+//   Without them the first non-option argument is the pattern.
+//   -F                    patterns are fixed strings, not regexes
+//   -i                    ignore case (ASCII letters) in patterns and input
+//   -c / -l / -q          print counts / names of matching files / nothing
+//   -m NUM                stop reading a file after NUM matching lines
+//   -o                    print each match on its own line, not the whole line
+//   -b                    prefix output with its byte offset in the input
+//   -A / -B / -C NUM      also print NUM lines after / before / around each match,
+//                         "--" between groups that aren't adjacent
+//   --color[=WHEN]        highlight matches: never, always or auto (a TTY)
+//   -R                    -r, following symlinks to files and directories
+//   --include=GLOB        -r: only search files whose base name matches GLOB
+//   --exclude=GLOB        -r: skip files whose base name matches GLOB
+//   --exclude-dir=GLOB    -r: don't walk into directories that match GLOB
+//   --no-ignore           -r: walk into .git and what .gitignore / .ignore exclude
+//   -a                    -r: search binary files (a NUL early on) as text
+//   -z                    decompress gzip / zstd input (told by its magic bytes)
+//   --index-build DIR     index the files under DIR (DIR/.grep-index), or bring
+//                         the index up to date with what changed since
+//   --index DIR           -r over DIR, reading only the files its index can't rule out
+//   --backtrack-limit=N   steps per line for backreference patterns (0 = no limit)
+//   --line-buffered       flush stdout after every write (always on for a TTY)
+//   --stats[=FORMAT]      at exit, print to stderr what the search did: the engine
+//                         each pattern ran on, bytes and lines read, prefilter hit
+//                         rate, engine work and time spent; FORMAT text or json
+//   --trace=FILE          write debug trace records to FILE (builds with GREP_TRACE)
+struct Options {
+    std::vector<std::string> patterns;
+    bool fixed_strings = false;
+    bool ignore_case = false;        // -i
+    bool count = false;              // -c
+    bool files_with_matches = false; // -l
+    bool quiet = false;              // -q: exit status only, stop at the first match
+    uint64_t max_count = UINT64_MAX; // -m
+    bool only_matching = false;      // -o
+    bool byte_offset = false;        // -b
+    bool context = false;            // any of -A, -B, -C, even with 0
+    uint64_t after_context = 0;      // -A
+    uint64_t before_context = 0;     // -B
+    bool color = false;              // --color, resolved against the TTY
+    std::vector<std::string> paths;
+    bool recursive = false;
+    bool dereference = false;        // -R
+    std::vector<std::string> include, exclude, exclude_dir;
+    bool no_ignore = false;
+    bool text = false;               // -a
+    bool decompress = false;         // -z
+    std::string index_build;         // --index-build: the directory to index
+    std::string index;               // --index: the indexed directory to search
+    unsigned jobs = 1;          // search threads; 0 on the command line = all cores
+    bool ordered = false;       // keep sequential output order under -j
+    uint64_t backtrack_limit = 10'000'000;
+    bool line_buffered = false;
+    enum class Stats { None, Text, Json };
+    Stats stats = Stats::None;  // --stats
+    std::string trace_file;
+};
+
+// throws std::runtime_error with a usage message on bad input
+Options parse_options(int argc, char* argv[]);
@@ -0,0 +1,64 @@
+#include "pattern_set.hpp"
+#include "aho_corasick.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// the pattern matching `lit` as a fixed string
+static std::string escape_literal(const std::string& lit){
+    static const char* meta = "\\[]^$*+?.(){}|";
+    std::string out;
+    for (char c : lit){
+        if (std::strchr(meta, c)) out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+PatternSet::PatternSet(const std::vector<std::string>& patterns, bool fixed_strings,
+                       const RegexOptions& opts){
+    std::vector<std::string> literals, plain, backref;
+    engine_of_.reserve(patterns.size());
+    for (const auto& p : patterns){
+        if (fixed_strings){
+            if (p.empty()) plain.push_back(p); // matches every line
+            else literals.push_back(p);
+            engine_of_.push_back(p.empty() ? 1 : 0);
+            continue;
+        }
+        std::vector<Token> toks = tokenize(p);
+        auto is = [&](TokenType t){ return [t](const Token& k){ return k.type == t; }; };
+        if (!toks.empty() && std::all_of(toks.begin(), toks.end(), is(TokenType::Literal))){
+            std::string lit;
+            for (const Token& t : toks) lit += t.data;
+            if (lit.find('\n') == std::string::npos){
+                literals.push_back(std::move(lit));
+                engine_of_.push_back(0);
+                continue;
+            }
+        }
+        bool has_backref = std::any_of(toks.begin(), toks.end(), is(TokenType::BackRef));
+        (has_backref ? backref : plain).push_back(p);
+        engine_of_.push_back(has_backref ? 2 : 1);
+    }
+    if (literals.size() == 1){
+        plain.push_back(escape_literal(literals[0]));
+        literals.clear();
+        std::replace(engine_of_.begin(), engine_of_.end(), uint8_t(0), uint8_t(1));
+    }
+
+    if (!literals.empty()) literals_ = std::make_unique<AhoCorasick>(literals, opts.ignore_case);
+    if (!plain.empty()) regex_ = std::make_unique<Regex>(plain, opts);
+    if (!backref.empty()) backref_ = std::make_unique<Regex>(backref, opts);
+    TRACE("compile", patterns.size() << " patterns: " << literals.size() << " literal, "
+          << plain.size() << " dfa, " << backref.size() << " backtrack");
+}
+
+PatternSet::~PatternSet() = default;
+
+bool PatternSet::match(std::string_view line) const {
+    if (literals_ && literals_->scan(line, 0) != std::string_view::npos) return true;
+    if (regex_ && regex_->match(line)) return true;
+    return backref_ && backref_->match(line);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "regex.hpp"
+
+class AhoCorasick;
+namespace grepcore { class Matcher; class Scanner; class Matches; }
+
+// All the patterns of one run (-e, -f or the single positional one), split
+// over the engine that handles each best:
+//
+//   - plain literals (or everything, with -F) go into one Aho-Corasick
+//     automaton;
+//   - other patterns without backreferences are merged into one alternation
+//     and run as a single DFA;
+//   - patterns with backreferences are merged into one backtracking Regex.
+//
+// A line matches if any pattern matches it; grepcore::Scanner (lines) and
+// grepcore::Matches (spans) drive all three engines at once. A lone literal is left to the
+// Regex, whose SIMD literal search beats the automaton for one needle.
+class PatternSet {
+public:
+    PatternSet(const std::vector<std::string>& patterns, bool fixed_strings,
+               const RegexOptions& opts = {});
+    ~PatternSet();
+    PatternSet(const PatternSet&) = delete;
+    PatternSet& operator=(const PatternSet&) = delete;
+
+    bool match(std::string_view line) const;
+
+private:
+    friend class grepcore::Matcher;
+    friend class grepcore::Scanner;
+    friend class grepcore::Matches;
+
+    std::unique_ptr<AhoCorasick> literals_;
+    std::unique_ptr<Regex> regex_;     // backreference-free patterns
+    std::unique_ptr<Regex> backref_;   // patterns the DFA can't run
+    std::vector<uint8_t> engine_of_;   // per pattern: 0 literals_, 1 regex_, 2 backref_
+};
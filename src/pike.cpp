@@ -0,0 +1,151 @@
+#include "pike.hpp"
+#include "counters.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+struct Thread {
+    uint32_t pc;
+    uint32_t count; // bytes consumed so far by the Run at pc
+    size_t start;
+};
+
+// one list of threads plus the generation marks that dedup them by pc (and
+// for a Run, by pc at count 0 and at the count past which an unbounded run
+// no longer changes anything)
+struct Scratch {
+    std::vector<Thread> run, next;
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> mark, mark_full;
+    uint32_t gen = 0;
+};
+
+Scratch& scratch(){
+    thread_local Scratch s;
+    return s;
+}
+
+} // namespace
+
+bool PikeVm::find(std::string_view s, size_t from, bool longest, grepcore::Span& out) const {
+    Scratch& m = scratch();
+    const size_t n = s.size();
+    const auto& insts = prog_.insts;
+    if (m.mark.size() < insts.size()){
+        m.mark.assign(insts.size(), 0);
+        m.mark_full.assign(insts.size(), 0);
+    }
+    m.run.clear();
+
+    // Follow the empty-width instructions from pc in priority order and add
+    // the Byte, Run and Match instructions reached to `list`, once per pc. Only
+    // the instructions that can be reached twice in one step are marked:
+    // every cycle goes through a Split.
+    auto add = [&](std::vector<Thread>& list, uint32_t pc0, size_t start, size_t pos){
+        m.stack.clear();
+        m.stack.push_back(pc0);
+        while (!m.stack.empty()){
+            uint32_t pc = m.stack.back();
+            m.stack.pop_back();
+            const Inst& in = insts[pc];
+            switch (in.op){
+                case Op::Byte:
+                case Op::Run:
+                case Op::Match:
+                    if (m.mark[pc] == m.gen) break;
+                    m.mark[pc] = m.gen;
+                    list.push_back({pc, 0, start});
+                    break;
+                case Op::Split: {
+                    uint32_t body = loop_start(in, pc);
+                    if (m.mark[pc] != m.gen){
+                        m.mark[pc] = m.gen;
+                        m.stack.push_back(in.y);
+                        m.stack.push_back(in.x);
+                    } else if (body != kNoLoop){
+                        // Back at a loop's Split without consuming anything.
+                        // As in the backtracker, the empty iteration leaves
+                        // the loop, with this path's priority.
+                        m.stack.push_back(body == in.x ? in.y : in.x);
+                    }
+                    break;
+                }
+                case Op::Jmp:     m.stack.push_back(in.x); break;
+                case Op::Save:    m.stack.push_back(pc + 1); break;
+                case Op::Bol:     if (pos == 0) m.stack.push_back(pc + 1); break;
+                case Op::Eol:     if (pos == n) m.stack.push_back(pc + 1); break;
+                case Op::BackRef: // not in a Prog this runs
+                case Op::Fail:    break;
+            }
+        }
+    };
+
+    bool found = false;
+    uint64_t starts = 0;
+    auto new_gen = [&]{
+        if (++m.gen == 0){
+            std::fill(m.mark.begin(), m.mark.end(), 0);
+            std::fill(m.mark_full.begin(), m.mark_full.end(), 0);
+            m.gen = 1;
+        }
+    };
+    new_gen();
+    const bool anchored = prog_.anchor == Anchor::Start;
+    for (size_t pos = from; pos <= n; ++pos){
+        if (m.run.empty()){
+            // nothing in flight: go straight to the next candidate start
+            if (found || (anchored && pos > 0)) break;
+            if (!prog_.nullable){
+                pos = prog_.skip.span(s, pos);
+                if (pos == n) break;
+            }
+        }
+        // until something matched, a match may also start here
+        if (!found && (!anchored || pos == 0)){
+            add(m.run, prog_.start, pos, pos);
+            ++starts;
+        }
+        new_gen();
+        if (m.run.empty()) continue;
+        m.next.clear();
+        for (const Thread& t : m.run){
+            // threads are in start order: once a match is known, the ones
+            // that started after it can only find matches further right
+            if (found && longest && t.start > out.begin) break;
+            const Inst& in = insts[t.pc];
+            if (in.op == Op::Match){
+                out = {t.start, pos};
+                found = true;
+                if (longest) continue; // those that started here too may run longer
+                break;                 // lower-priority threads lose to this match
+            }
+            if (pos == n || !prog_.sets[in.x].contains(static_cast<unsigned char>(s[pos]))) continue;
+            if (in.op == Op::Byte){
+                add(m.next, t.pc + 1, t.start, pos + 1);
+                continue;
+            }
+            // a Run: one more byte, then stay (at most max) or leave (at
+            // least min), in the order the repeat prefers
+            const Repeat& rep = prog_.repeats[in.y];
+            uint32_t count = t.count + 1;
+            bool stay = count < rep.max, leave = count >= rep.min;
+            if (leave && rep.lazy) add(m.next, t.pc + 1, t.start, pos + 1);
+            if (stay){
+                // past min an unbounded run is the same whatever its count:
+                // keep the first thread to get there
+                if (rep.max != kUnbounded || count < rep.min){
+                    m.next.push_back({t.pc, count, t.start});
+                } else if (m.mark_full[t.pc] != m.gen){
+                    m.mark_full[t.pc] = m.gen;
+                    m.next.push_back({t.pc, rep.min, t.start});
+                }
+            }
+            if (leave && !rep.lazy) add(m.next, t.pc + 1, t.start, pos + 1);
+        }
+        std::swap(m.run, m.next);
+    }
+    counters::add(counters::local().starts, starts);
+    return found;
+}
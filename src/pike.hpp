@@ -0,0 +1,32 @@
+#pragma once
+#include <string_view>
+
+#include "grepcore.hpp"
+#include "prog.hpp"
+
+// Breadth-first simulation of a backreference-free Prog (a Pike VM) that
+// reports where a match starts and ends, which the DFA can't tell. All
+// threads advance over the line together, each carrying the offset it
+// started at. A Run keeps one thread per count it has reached (up to max,
+// or min when unbounded), so the cost is O(line * (insts + the counts of
+// the bounded repeats)): on a long line of a's, a{30000} steps 30000
+// threads per byte. It only runs on lines the DFA has already found to
+// match.
+//
+// Threads are kept in priority order; a start offset tried later is always
+// lower priority, which makes the first match to complete at the smallest
+// start the leftmost one. Leftmost-first results follow the backtracker's
+// except where a loop body can match empty: threads are merged per
+// instruction, so which empty iteration wins may differ (as in RE2).
+class PikeVm {
+public:
+    explicit PikeVm(const Prog& prog) : prog_(prog) {}
+
+    // Leftmost match starting at or after `from` in `line` (anchors see the
+    // whole line): the longest one there, or with `longest` false the one
+    // that the backtracker would find first.
+    bool find(std::string_view line, size_t from, bool longest, grepcore::Span& out) const;
+
+private:
+    const Prog& prog_;
+};
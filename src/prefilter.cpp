@@ -0,0 +1,240 @@
+#include "prefilter.hpp"
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PREFILTER_X86 1
+#endif
+
+// ---- literal extraction ----------------------------------------------------
+
+// rough byte frequency in text and logs: lower is more common
+static int byte_rank(unsigned char c){
+    static const char* common = " etaoinsrhldcumfpgwybvk0123456789.,:-_/=\t\"'xjqz";
+    const char* p = std::strchr(common, c);
+    return (c && p) ? static_cast<int>(p - common) : 1000 - (c >= 0x80);
+}
+
+static bool is_letter(char c){
+    unsigned char l = c | 0x20;
+    return l >= 'a' && l <= 'z';
+}
+
+namespace {
+
+// longest run of one repeated literal byte taken into a factor
+constexpr uint32_t kMaxRepeat = 64;
+
+struct Factors {
+    const Regex& re;
+    std::vector<std::string> out;
+    std::string run;
+
+    void flush(){
+        if (!run.empty()) out.push_back(run);
+        run.clear();
+    }
+
+    // walk the mandatory sequence [L, R), extending `run` across adjacent
+    // literals (and into plain groups) and cutting it at anything else
+    void walk(size_t L, size_t R){
+        if (re.alternatives(L, R)){ flush(); return; }
+        const std::vector<Token>& toks = re.tokens();
+        size_t j = L;
+        while (j < R){
+            const Token& tok = toks[j];
+            size_t next = tok.type == TokenType::LeftParen ? re.rparen(j) + 1 : j + 1;
+            // stacked quantifiers multiply: only a single one is looked into
+            size_t end = next;
+            while (end < R && is_quantifier(toks[end].type)) ++end;
+            uint32_t min = end == next ? 1 : end == next + 1 ? toks[next].min : 0;
+            uint32_t max = end == next ? 1 : end == next + 1 ? toks[next].max : kUnbounded;
+            bool optional = min == 0;
+            bool exact = min == 1 && max == 1;
+
+            if (tok.type == TokenType::LeftParen){
+                if (optional){ flush(); }
+                else if (!exact){ flush(); walk(j + 1, next - 1); flush(); }
+                else walk(j + 1, next - 1);
+            }
+            else if (tok.type == TokenType::Literal && tok.data[0] != '\n'){
+                if (optional) flush();
+                else {
+                    // a{3} needs "aaa"; a{3,} or a{3,5} needs it next to
+                    // what comes before only
+                    run.append(std::min<uint32_t>(min, kMaxRepeat), tok.data[0]);
+                    if (max != min || min > kMaxRepeat) flush();
+                }
+            }
+            else if (tok.type == TokenType::StartAnchor || tok.type == TokenType::EndAnchor){
+                // zero width: does not break adjacency
+            }
+            else flush();
+
+            j = end;
+        }
+    }
+};
+
+} // namespace
+
+std::vector<std::string> required_literals(const Regex& re){
+    Factors f{re, {}, {}};
+    f.walk(0, re.tokens().size());
+    f.flush();
+    return f.out;
+}
+
+std::string best_literal(const std::vector<std::string>& factors){
+    std::string best;
+    int best_score = 0;
+    for (const auto& lit : factors){
+        int score = 0;
+        for (unsigned char c : lit) score += 1 + std::min(byte_rank(c), 60) / 6;
+        if (score > best_score){ best = lit; best_score = score; }
+    }
+    return best;
+}
+
+// ---- substring search ------------------------------------------------------
+
+struct SearchImpl {
+    template <bool Fold>
+    static bool verify(const LiteralSearcher& s, const char* at){
+        const std::string& nd = s.needle_;
+        if constexpr (Fold) return equal_fold(at, nd.data(), nd.size());
+        return std::memcmp(at, nd.data(), nd.size()) == 0;
+    }
+
+    // what a compared byte is or-ed with before the compare: 0x20 turns an
+    // upper case letter into the lower case one the needle holds
+    template <bool Fold>
+    static char fold_mask(char c){
+        return Fold && is_letter(c) ? 0x20 : 0;
+    }
+
+    template <bool Fold>
+    static size_t scalar(const LiteralSearcher& s, const char* h, size_t n, size_t from){
+        const std::string& nd = s.needle_;
+        size_t k = nd.size(), r = s.rare1_;
+        if (n - from < k) return std::string_view::npos;
+        if (fold_mask<Fold>(nd[r])){
+            // a letter: memchr can't look for both cases at once
+            const unsigned char want = nd[r];
+            for (size_t i = from + r; i < n; ++i){
+                if (fold_case(h[i]) != want) continue;
+                size_t start = i - r;
+                if (start + k > n) break;
+                if (verify<Fold>(s, h + start)) return start;
+            }
+            return std::string_view::npos;
+        }
+        // look for the rarest byte, then verify the window around it
+        size_t i = from + r;
+        while (i < n){
+            const void* p = std::memchr(h + i, nd[r], n - i);
+            if (!p) break;
+            size_t start = static_cast<const char*>(p) - h - r;
+            if (start + k > n) break;
+            if (verify<Fold>(s, h + start)) return start;
+            i = start + r + 1;
+        }
+        return std::string_view::npos;
+    }
+
+#ifdef PREFILTER_X86
+    template <bool Fold>
+    __attribute__((target("avx2")))
+    static size_t avx2(const LiteralSearcher& s, const char* h, size_t n, size_t from){
+        const std::string& nd = s.needle_;
+        size_t k = nd.size();
+        const __m256i b1 = _mm256_set1_epi8(nd[s.rare1_]);
+        const __m256i b2 = _mm256_set1_epi8(nd[s.rare2_]);
+        const __m256i m1 = _mm256_set1_epi8(fold_mask<Fold>(nd[s.rare1_]));
+        const __m256i m2 = _mm256_set1_epi8(fold_mask<Fold>(nd[s.rare2_]));
+        size_t i = from;
+        for (; i + k + 31 <= n; i += 32){
+            __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + s.rare1_));
+            __m256i x2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + s.rare2_));
+            if constexpr (Fold){
+                x1 = _mm256_or_si256(x1, m1);
+                x2 = _mm256_or_si256(x2, m2);
+            }
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(x1, b1), _mm256_cmpeq_epi8(x2, b2))));
+            while (mask){
+                size_t at = i + __builtin_ctz(mask);
+                if (verify<Fold>(s, h + at)) return at;
+                mask &= mask - 1;
+            }
+        }
+        return scalar<Fold>(s, h, n, i);
+    }
+
+    template <bool Fold>
+    __attribute__((target("sse4.2")))
+    static size_t sse42(const LiteralSearcher& s, const char* h, size_t n, size_t from){
+        const std::string& nd = s.needle_;
+        size_t k = nd.size();
+        const __m128i b1 = _mm_set1_epi8(nd[s.rare1_]);
+        const __m128i b2 = _mm_set1_epi8(nd[s.rare2_]);
+        const __m128i m1 = _mm_set1_epi8(fold_mask<Fold>(nd[s.rare1_]));
+        const __m128i m2 = _mm_set1_epi8(fold_mask<Fold>(nd[s.rare2_]));
+        size_t i = from;
+        for (; i + k + 15 <= n; i += 16){
+            __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + s.rare1_));
+            __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + s.rare2_));
+            if constexpr (Fold){
+                x1 = _mm_or_si128(x1, m1);
+                x2 = _mm_or_si128(x2, m2);
+            }
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(x1, b1), _mm_cmpeq_epi8(x2, b2))));
+            while (mask){
+                size_t at = i + __builtin_ctz(mask);
+                if (verify<Fold>(s, h + at)) return at;
+                mask &= mask - 1;
+            }
+        }
+        return scalar<Fold>(s, h, n, i);
+    }
+#endif
+
+    template <bool Fold>
+    static LiteralSearcher::FindFn pick(size_t k){
+        (void)k;
+#ifdef PREFILTER_X86
+        if (k > 1){
+            if (__builtin_cpu_supports("avx2")) return &avx2<Fold>;
+            if (__builtin_cpu_supports("sse4.2")) return &sse42<Fold>;
+        }
+#endif
+        return &scalar<Fold>; // memchr is already vectorized by libc
+    }
+};
+
+LiteralSearcher::LiteralSearcher(std::string needle, bool ignore_case) : needle_(std::move(needle)) {
+    if (ignore_case){
+        for (char& c : needle_){
+            fold_ |= is_letter(c); // else there is nothing to fold
+            c = static_cast<char>(fold_case(c));
+        }
+    }
+    size_t k = needle_.size();
+    for (size_t i = 1; i < k; ++i){
+        if (byte_rank(needle_[i]) > byte_rank(needle_[rare1_])) rare1_ = i;
+    }
+    rare2_ = rare1_ == 0 && k > 1 ? 1 : 0;
+    for (size_t i = 0; i < k; ++i){
+        if (i != rare1_ && byte_rank(needle_[i]) > byte_rank(needle_[rare2_])) rare2_ = i;
+    }
+    find_ = fold_ ? SearchImpl::pick<true>(k) : SearchImpl::pick<false>(k);
+}
+
+size_t LiteralSearcher::find(std::string_view hay, size_t from) const {
+    if (from >= hay.size()) return std::string_view::npos;
+    return find_(*this, hay.data(), hay.size(), from);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Regex;
+
+// Literal strings every match of the pattern must contain. Only factors of
+// the mandatory top-level sequence are taken: nothing under '|', '?', '*'
+// or {0,m}, or behind a class, so a buffer region without the factor cannot
+// match. A literal repeated exactly, as in a{3}, counts that many times.
+std::vector<std::string> required_literals(const Regex& re);
+
+// the factor expected to reject the most input: long and made of rare bytes
+std::string best_literal(const std::vector<std::string>& factors);
+
+// Vectorized substring search used to skip input that cannot match. The two
+// rarest bytes of the needle are compared 32 (AVX2) or 16 (SSE4.2) positions
+// at a time and only the candidates are verified with memcmp; a memchr based
+// scalar loop covers other CPUs. The variant is picked once at construction.
+//
+// With `ignore_case` ASCII letters match in either case: a letter among the
+// two compared bytes is matched as (byte | 0x20), which costs one OR per
+// block, and candidates are verified folded.
+class LiteralSearcher {
+public:
+    explicit LiteralSearcher(std::string needle, bool ignore_case = false);
+
+    // first occurrence at or after `from`, or npos
+    size_t find(std::string_view hay, size_t from) const;
+
+    const std::string& needle() const { return needle_; }
+
+    using FindFn = size_t (*)(const LiteralSearcher&, const char*, size_t, size_t);
+
+private:
+    friend struct SearchImpl;
+
+    std::string needle_;
+    size_t rare1_ = 0;  // positions of the two rarest needle bytes
+    size_t rare2_ = 0;
+    bool fold_ = false;   // needle_ is folded to lower case
+    FindFn find_ = nullptr;
+};
@@ -0,0 +1,214 @@
+#include "prog.hpp"
+#include "regex.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+// Bound on the program size, which repeated groups multiply.
+constexpr size_t kMaxInsts = size_t(1) << 20;
+constexpr uint32_t kNoSet = UINT32_MAX;
+
+struct Compiler {
+    const Regex& re;
+    const std::vector<Token>& toks;
+    Prog prog;
+
+    explicit Compiler(const Regex& r) : re(r), toks(r.tokens()) {}
+
+    uint32_t pc() const { return static_cast<uint32_t>(prog.insts.size()); }
+
+    uint32_t emit(Op op, uint32_t x = 0, uint32_t y = 0){
+        prog.insts.push_back({op, x, y});
+        return pc() - 1;
+    }
+
+    uint32_t add_set(const std::bitset<256>& set){
+        for (size_t k = 0; k < prog.sets.size(); ++k){
+            if (prog.sets[k].bits() == set) return static_cast<uint32_t>(k);
+        }
+        prog.sets.emplace_back(set);
+        return static_cast<uint32_t>(prog.sets.size() - 1);
+    }
+
+    // [L, R) is a whole group body (or the whole pattern): emit its branches
+    void alt(size_t L, size_t R){
+        const Regex::Parts* parts = re.alternatives(L, R);
+        if (!parts){ seq(L, R); return; }
+
+        std::vector<uint32_t> jumps;
+        for (size_t k = 0; k < parts->size(); ++k){
+            auto [a, b] = (*parts)[k];
+            if (k + 1 == parts->size()){ seq(a, b); break; }
+            uint32_t split = emit(Op::Split, pc() + 1);
+            seq(a, b);
+            jumps.push_back(emit(Op::Jmp));
+            prog.insts[split].y = pc();
+        }
+        for (uint32_t j : jumps) prog.insts[j].x = pc();
+    }
+
+    uint32_t add_repeat(const Repeat& rep){
+        prog.repeats.push_back(rep);
+        return static_cast<uint32_t>(prog.repeats.size() - 1);
+    }
+
+    // a Split taking the branch at `stay` first, or `leave` first if lazy
+    void patch_split(uint32_t split, uint32_t stay, uint32_t leave, bool lazy){
+        prog.insts[split].x = lazy ? leave : stay;
+        prog.insts[split].y = lazy ? stay : leave;
+    }
+
+    // Repeat what body() emits min to max times. A single-byte atom (set
+    // other than kNoSet) becomes one Run instruction whatever the counts;
+    // anything else is emitted once per required copy, once more as the
+    // loop for an unbounded max, and once per optional copy up to max.
+    template <typename Body>
+    void repeat(uint32_t min, uint32_t max, bool lazy, uint32_t set, Body body){
+        if (max == 0) return;
+        if (set != kNoSet && max > 1){
+            uint32_t split = min == 0 ? emit(Op::Split) : kNoSet;
+            emit(Op::Run, set, add_repeat({std::max(min, 1u), max, lazy}));
+            if (split != kNoSet) patch_split(split, split + 1, pc(), lazy);
+            return;
+        }
+        auto copy = [&]{
+            body();
+            if (prog.insts.size() > kMaxInsts) throw std::runtime_error("Regular expression too big");
+        };
+        if (max == kUnbounded){
+            // x{n,} is n-1 copies then x+; x* is (x+)?
+            for (uint32_t k = 1; k < min; ++k) copy();
+            uint32_t split = min == 0 ? emit(Op::Split) : kNoSet;
+            uint32_t loop = pc();
+            copy();
+            uint32_t back = emit(Op::Split);
+            patch_split(back, loop, pc(), lazy);
+            if (split != kNoSet) patch_split(split, split + 1, pc(), lazy);
+            return;
+        }
+        for (uint32_t k = 0; k < min; ++k) copy();
+        std::vector<uint32_t> splits;
+        for (uint32_t k = min; k < max; ++k){
+            splits.push_back(emit(Op::Split));
+            copy();
+        }
+        for (uint32_t split : splits) patch_split(split, split + 1, pc(), lazy);
+    }
+
+    // emit one element with the quantifiers following it at toks[next...];
+    // `set` is its byte set when it is a single-byte atom. Stacked
+    // quantifiers nest: a{2}{3} is (a{2}){3}. Returns the index of the
+    // next element.
+    template <typename Body>
+    size_t quantified(size_t next, size_t R, Body body, uint32_t set = kNoSet){
+        size_t end = next;
+        while (end < R && is_quantifier(toks[end].type)) ++end;
+        emit_quantified(next, end, set, body);
+        return end;
+    }
+
+    template <typename Body>
+    void emit_quantified(size_t next, size_t end, uint32_t set, Body& body){
+        if (next == end){ body(); return; }
+        const Token& q = toks[end - 1];
+        if (next + 1 == end){ repeat(q.min, q.max, q.lazy, set, body); return; }
+        auto inner = [&]{ emit_quantified(next, end - 1, set, body); };
+        repeat(q.min, q.max, q.lazy, kNoSet, inner);
+    }
+
+    void seq(size_t L, size_t R){
+        size_t j = L;
+        while (j < R){
+            const Token& tok = toks[j];
+            switch (tok.type){
+                case TokenType::StartAnchor: emit(Op::Bol); ++j; break;
+                case TokenType::EndAnchor:   emit(Op::Eol); ++j; break;
+                case TokenType::BackRef: {
+                    int gid = std::stoi(tok.data);
+                    // a reference to a group that doesn't exist never matches
+                    bool valid = gid > 0 && gid <= re.max_gid();
+                    if (valid) prog.has_backrefs = true;
+                    j = quantified(j + 1, R, [&]{
+                        if (valid) emit(Op::BackRef, static_cast<uint32_t>(gid));
+                        else emit(Op::Fail);
+                    });
+                    break;
+                }
+                case TokenType::LeftParen: {
+                    size_t r = re.rparen(j);
+                    uint32_t gid = static_cast<uint32_t>(re.gid_at_open(j));
+                    j = quantified(r + 1, R, [&]{
+                        emit(Op::Save, 2 * gid);
+                        alt(j + 1, r);
+                        emit(Op::Save, 2 * gid + 1);
+                    });
+                    break;
+                }
+                default: {
+                    uint32_t set = add_set(tok.set); // empty for a stray quantifier
+                    j = quantified(j + 1, R, [&]{ emit(Op::Byte, set); }, set);
+                    break;
+                }
+            }
+        }
+    }
+};
+
+// Walk the empty transitions from the start to every Byte and Match that a
+// match can begin with. '^' and '$' are assumed to hold, which can only make
+// the sets larger; a path reaching one without passing '^' unanchors it.
+void analyze_start(Prog& prog){
+    std::vector<bool> seen(prog.insts.size() * 2, false);
+    std::vector<std::pair<uint32_t, bool>> work{{prog.start, false}};
+    bool anchored = true;
+    while (!work.empty()){
+        auto [pc, after_bol] = work.back();
+        work.pop_back();
+        if (seen[2 * pc + after_bol]) continue;
+        seen[2 * pc + after_bol] = true;
+        const Inst& in = prog.insts[pc];
+        switch (in.op){
+            case Op::Byte:
+            case Op::Run:
+                prog.first |= prog.sets[in.x].bits();
+                anchored &= after_bol;
+                break;
+            case Op::Match:
+                prog.nullable = true;
+                anchored &= after_bol;
+                break;
+            case Op::BackRef: // may be empty: past it, anything can come first
+                prog.nullable = true;
+                prog.first.set();
+                anchored &= after_bol;
+                break;
+            case Op::Split:
+                work.push_back({in.y, after_bol});
+                work.push_back({in.x, after_bol});
+                break;
+            case Op::Jmp:  work.push_back({in.x, after_bol}); break;
+            case Op::Bol:  work.push_back({pc + 1, true}); break;
+            case Op::Eol:
+            case Op::Save: work.push_back({pc + 1, after_bol}); break;
+            case Op::Fail: break;
+        }
+    }
+    if (anchored) prog.anchor = Anchor::Start;
+    prog.skip = ByteSet(~prog.first);
+}
+
+} // namespace
+
+Prog compile_prog(const Regex& re){
+    Compiler c(re);
+    c.prog.ngroups = re.max_gid() + 1;
+    c.prog.start = c.pc();
+    c.alt(0, re.tokens().size());
+    c.emit(Op::Match);
+    analyze_start(c.prog);
+    return std::move(c.prog);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "byteset.hpp"
+
+class Regex;
+
+// Thompson NFA built from the token stream. Every instruction except Split,
+// Jmp and Fail falls through to pc + 1 when it succeeds.
+enum class Op : uint8_t {
+    Byte,    // consume one byte contained in sets[x]
+    Run,     // consume repeats[y].min to .max bytes contained in sets[x]
+    Split,   // continue at x, or at y (x is preferred)
+    Jmp,     // continue at x
+    Save,    // record the input position in capture slot x
+    Bol,     // assert start of line
+    Eol,     // assert end of line
+    BackRef, // consume the text captured by group x
+    Match,
+    Fail
+};
+
+struct Inst {
+    Op op;
+    uint32_t x = 0;
+    uint32_t y = 0;
+};
+
+constexpr uint32_t kUnbounded = UINT32_MAX;
+
+// Bounds of a counted repetition of one byte set ('+', '*' and {n,m} on a
+// single-byte atom). min is at least 1: an optional run is a Split in front
+// of the Run. A lazy run prefers to stop as early as it can.
+struct Repeat {
+    uint32_t min = 1;
+    uint32_t max = kUnbounded;
+    bool lazy = false;
+};
+
+constexpr uint32_t kNoLoop = UINT32_MAX;
+
+// The target a Split at pc jumps back to, the first instruction of the loop
+// it closes, or kNoLoop if both targets are ahead. A greedy loop prefers
+// going back (x), a lazy one leaving (y).
+inline uint32_t loop_start(const Inst& in, uint32_t pc){
+    if (in.x <= pc) return in.x;
+    if (in.y <= pc) return in.y;
+    return kNoLoop;
+}
+
+// Where a match may begin, worked out from the instructions reachable from
+// the start without consuming input.
+enum class Anchor : uint8_t {
+    None,   // anywhere
+    Start   // only at the start of the line: every branch begins with '^'
+};
+
+struct Prog {
+    std::vector<Inst> insts;
+    std::vector<ByteSet> sets;          // byte sets used by Op::Byte and Op::Run
+    std::vector<Repeat> repeats;        // bounds used by Op::Run
+    uint32_t start = 0;
+    int ngroups = 0;                    // capture slots are 2*g and 2*g+1
+    bool has_backrefs = false;          // not expressible as a DFA
+    bool ignore_case = false;           // BackRef compares with ASCII case folded
+
+    Anchor anchor = Anchor::None;
+    bool nullable = false;              // can match without consuming a byte
+    std::bitset<256> first;             // bytes a non-empty match can begin with
+    // Bytes no match begins with. Unless the pattern is nullable, the next
+    // candidate start from pos is skip.span(line, pos), and none is left
+    // once that reaches the end of the line.
+    ByteSet skip;
+};
+
+Prog compile_prog(const Regex& re);
@@ -0,0 +1,424 @@
+#include "regex.hpp"
+#include "backtrack.hpp"
+#include "dfa.hpp"
+#include "pike.hpp"
+#include "prefilter.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+static std::bitset<256> digit_set(){
+    std::bitset<256> set;
+    for (int c = '0'; c <= '9'; ++c) set.set(c);
+    return set;
+}
+
+static std::bitset<256> word_set(){
+    std::bitset<256> set = digit_set();
+    for (int c = 'a'; c <= 'z'; ++c){ set.set(c); set.set(c - 'a' + 'A'); }
+    set.set('_');
+    return set;
+}
+
+static std::bitset<256> byte_set(char c){
+    std::bitset<256> set;
+    set.set(static_cast<unsigned char>(c));
+    return set;
+}
+
+// Largest count allowed in {n,m}, as in GNU grep.
+static constexpr uint32_t kMaxCount = 32767;
+
+static bool parse_number(const std::string& p, size_t& i, uint32_t& out){
+    size_t start = i;
+    uint64_t v = 0;
+    while (i < p.size() && std::isdigit(static_cast<unsigned char>(p[i]))){
+        v = std::min<uint64_t>(v * 10 + (p[i] - '0'), kMaxCount + 1);
+        ++i;
+    }
+    if (i == start) return false;
+    out = static_cast<uint32_t>(v);
+    return true;
+}
+
+// {n}, {n,}, {,m} or {n,m} at p[i]; appends the quantifier and moves i past
+// it. Anything else isn't an interval and leaves the '{' a literal.
+static bool parse_count(const std::string& p, size_t& i, std::vector<Token>& toks){
+    size_t j = i + 1;
+    uint32_t lo = 0, hi = kUnbounded;
+    bool have_lo = parse_number(p, j, lo);
+    if (j < p.size() && p[j] == ','){
+        ++j;
+        parse_number(p, j, hi);
+    } else {
+        if (!have_lo) return false;
+        hi = lo;
+    }
+    if (j >= p.size() || p[j] != '}') return false;
+    if ((hi != kUnbounded && hi > kMaxCount) || lo > kMaxCount){
+        throw std::runtime_error("Regular expression too big");
+    }
+    if (hi < lo) throw std::runtime_error("Invalid content of \\{\\}");
+    toks.push_back({TokenType::CountQuantifier, "", {}, lo, hi});
+    i = j + 1;
+    return true;
+}
+
+ // only for the pattern
+ //const std::string& -> I don’t want to copy the string, but I promise not to change it.
+std::vector<Token> tokenize(const std::string& pattern){
+    std::vector<Token> toks;
+    std::size_t i = 0, n = pattern.size();
+    while (i < n){
+        char c = pattern[i];
+
+        //Escape: \d , \w
+
+        if (c == '\\'){
+            char next = pattern[i+1];
+            if (next == 'd'){
+                toks.push_back({TokenType::Digit, "", digit_set()});
+                i += 2;
+            } else if (next == 'w'){
+                toks.push_back({TokenType::WordChar, "", word_set()});
+                i += 2;
+            } else if (next >= '1' && next <= '9'){
+                size_t j = i + 1; // start at first digit
+                while (j < n && std::isdigit(static_cast<unsigned char>(pattern[j]))) {
+                    ++j;
+                }
+                // digits are [i+1, j)
+                toks.push_back({TokenType::BackRef, std::string(pattern.begin() + (i + 1),
+                                                                pattern.begin() + j)});
+                i = j;            // consume '\' and all digits
+                continue;
+            } else {
+                toks.push_back({TokenType::Literal, std::string(1, next), byte_set(next)});
+                i += 2;
+            }
+        }
+        else if (c == '['){
+            std::size_t j = i + 1;
+            bool is_negative = false;
+            if (pattern[j] == '^') {is_negative = true; j++;}
+
+            // \d and \w expand to their sets and a-z to a range; any other
+            // escaped byte stands for itself, a '-' first or last is literal
+            std::bitset<256> cls;
+            for (; j < n; ++j) {
+                if (pattern[j] == ']') break;
+                unsigned char lo = pattern[j];
+                if (lo == '\\' && j + 1 < n){
+                    char e = pattern[++j];
+                    if (e == 'd'){ cls |= digit_set(); continue; }
+                    if (e == 'w'){ cls |= word_set(); continue; }
+                    lo = e;
+                }
+                if (j + 2 < n && pattern[j+1] == '-' && pattern[j+2] != ']'){
+                    j += 2;
+                    unsigned char hi = pattern[j];
+                    if (hi == '\\' && j + 1 < n) hi = pattern[++j];
+                    if (hi < lo) throw std::runtime_error("Invalid range in character class");
+                    for (int k = lo; k <= hi; ++k) cls.set(k);
+                } else {
+                    cls.set(lo);
+                }
+            }
+            if (is_negative) cls.flip();
+            toks.push_back({is_negative ? TokenType::NegCharClass : TokenType::CharClass, "", cls});
+            i = j + 1;
+        }
+        else if (c == '^'){
+            toks.push_back({TokenType::StartAnchor, ""});
+            i += 1;
+        } 
+        else if (c == '$'){
+            toks.push_back({TokenType::EndAnchor, ""});
+            i += 1;
+        }
+        else if (c == '+' || c == '*' || c == '?'){
+            // a '?' right after a quantifier makes it lazy instead
+            if (c == '?' && !toks.empty() && is_quantifier(toks.back().type) && !toks.back().lazy){
+                toks.back().lazy = true;
+            } else if (c == '+'){
+                toks.push_back({TokenType::PlusQuantifier, "", {}, 1, kUnbounded});
+            } else if (c == '*'){
+                toks.push_back({TokenType::StarQuantifier, "", {}, 0, kUnbounded});
+            } else {
+                toks.push_back({TokenType::QuestionQuantifier, "", {}, 0, 1});
+            }
+            i += 1;
+        }
+        else if (c == '{' && parse_count(pattern, i, toks)){
+            // i is now past the '}'
+        }
+        else if (c == '.'){
+            toks.push_back({TokenType::AnyChar, "", std::bitset<256>().set()});
+            i += 1;
+        }
+        else if (c == '('){
+            toks.push_back({TokenType::LeftParen, ""});
+            i += 1;
+        }
+        else if (c == ')'){
+            toks.push_back({TokenType::RigthParen, ""});
+            i += 1;
+        }
+        else if (c == '|'){
+            toks.push_back({TokenType::Alternation, ""});
+            i += 1;
+        }
+        else {
+            toks.push_back({TokenType::Literal, std::string(1, c), byte_set(c)});
+            i++;
+        }
+    }
+    return toks;
+}
+
+// Several patterns become one alternation. The groups of each pattern are
+// numbered after those of the patterns before it, so its \N are shifted to
+// match; each pattern must balance its own parentheses.
+static std::vector<Token> tokenize_all(const std::vector<std::string>& patterns){
+    if (patterns.size() == 1) return tokenize(patterns[0]);
+    std::vector<Token> all;
+    int groups_before = 0;
+    for (size_t k = 0; k < patterns.size(); ++k){
+        std::vector<Token> toks = tokenize(patterns[k]);
+        int groups = 0, depth = 0;
+        for (const Token& t : toks){
+            if (t.type == TokenType::LeftParen){ ++groups; ++depth; }
+            else if (t.type == TokenType::RigthParen && --depth < 0) break;
+        }
+        if (depth != 0) throw std::runtime_error("Unmatched parenthesis in pattern '" + patterns[k] + "'");
+
+        if (k) all.push_back({TokenType::Alternation, ""});
+        for (Token& t : toks){
+            if (t.type == TokenType::BackRef){
+                int gid = std::stoi(t.data);
+                t.data = std::to_string(gid > 0 && gid <= groups ? gid + groups_before : 0);
+            }
+            all.push_back(std::move(t));
+        }
+        groups_before += groups;
+    }
+    return all;
+}
+
+static std::vector<std::pair<size_t, size_t>>
+split_alts(const std::vector<Token>& toks, size_t L, size_t R){
+    std::vector<std::pair<size_t, size_t>> parts;
+    size_t depth = 0, start = L;
+    for (size_t k = L; k < R; ++k){
+        if (toks[k].type == TokenType::LeftParen) depth++;
+        else if (toks[k].type == TokenType::RigthParen) depth--;
+        else if (toks[k].type == TokenType::Alternation && depth==0){
+            parts.push_back({start, k});
+            start = k + 1;
+        } 
+    }
+    parts.push_back({start, R});
+    return parts;
+}
+static size_t find_rparen(const std::vector<Token>& toks, size_t open_j){
+    size_t depth = 0;
+    for (size_t k = open_j; k < toks.size(); ++k){
+        if (toks[k].type == TokenType::LeftParen) depth++;
+        else if (toks[k].type == TokenType::RigthParen){
+            if (--depth == 0) return k; 
+        }
+    }
+    throw std::runtime_error("Unmatched '('");
+}
+
+
+static std::vector<int> number_groups(const std::vector<Token>& toks, int& max_gid){
+    std::vector<int> gid_at_open(toks.size(), -1);
+    int next = 1;
+    std::vector<size_t> stack;
+    for (size_t j = 0; j < toks.size(); ++j){
+        if (toks[j].type == TokenType::LeftParen){
+            gid_at_open[j] = next++;
+            stack.push_back(j);
+        } else if (toks[j].type == TokenType::RigthParen){
+            if (stack.empty()) throw std::runtime_error("Unmatched ')");
+            stack.pop_back();
+        }
+    }
+    if (!stack.empty()) throw std::runtime_error("Unmatched ')");
+    max_gid = next - 1; //for debug purpose
+    return gid_at_open;
+}
+Regex::Regex(const std::string& pattern, const RegexOptions& opts)
+    : Regex(std::vector<std::string>{pattern}, opts) {}
+
+// -i: every single-byte token accepts a letter in both cases, or, for a
+// negated class, in neither, as [^a] rejects 'A' too. Literal keeps its
+// text; the prefilter is told to fold it.
+static void fold_tokens(std::vector<Token>& toks){
+    for (Token& t : toks){
+        if (t.set.none()) continue;
+        std::bitset<256> folded = t.set;
+        for (int c = 'a'; c <= 'z'; ++c){
+            int u = c - 'a' + 'A';
+            bool in = t.type == TokenType::NegCharClass ? t.set[c] && t.set[u] : t.set[c] || t.set[u];
+            folded[c] = folded[u] = in;
+        }
+        t.set = folded;
+    }
+}
+
+Regex::Regex(const std::vector<std::string>& patterns, const RegexOptions& opts)
+    : toks_(tokenize_all(patterns))
+{
+    if (opts.ignore_case) fold_tokens(toks_);
+
+    // Parse once: everything below used to be recomputed for every line
+    gid_at_open_ = number_groups(toks_, max_gid_);
+
+    size_t n = toks_.size();
+    rparen_.assign(n, 0);
+    slice_end_.assign(n + 1, static_cast<size_t>(-1));
+    alts_.resize(n + 1);
+
+    slice_end_[0] = n;
+    alts_[0] = split_alts(toks_, 0, n);
+    for (size_t j = 0; j < n; ++j){
+        if (toks_[j].type != TokenType::LeftParen) continue;
+        size_t r = find_rparen(toks_, j);
+        rparen_[j] = r;
+        slice_end_[j + 1] = r;
+        alts_[j + 1] = split_alts(toks_, j + 1, r);
+    }
+
+    prog_ = compile_prog(*this);
+    prog_.ignore_case = opts.ignore_case;
+    use_dfa_ = !prog_.has_backrefs;
+    if (!use_dfa_) backtrack_ = std::make_unique<Backtracker>(prog_, opts.step_budget);
+    static std::atomic<uint64_t> next_serial{1};
+    serial_ = next_serial.fetch_add(1);
+    TRACE("compile", toks_.size() << " tokens, " << max_gid_ << " groups, "
+          << prog_.insts.size() << " insts, engine " << (use_dfa_ ? "dfa" : "backtrack"));
+
+    std::string best = best_literal(required_literals(*this));
+    // a lone common byte would flag most lines and only add overhead
+    static const std::string common = " etaoinsrhl";
+    if (best.size() > 1 || (best.size() == 1 && common.find(best[0]) == std::string::npos)){
+        literal_only_ = best.size() == toks_.size() &&
+            std::all_of(toks_.begin(), toks_.end(),
+                        [](const Token& t){ return t.type == TokenType::Literal; });
+        TRACE("prefilter", "literal \"" << best << "\"" << (literal_only_ ? " (exact)" : ""));
+        prefilter_ = std::make_unique<LiteralSearcher>(std::move(best), opts.ignore_case);
+    }
+}
+
+Regex::~Regex() = default;
+
+std::string_view Regex::prefilter_literal() const {
+    return prefilter_ ? std::string_view(prefilter_->needle()) : std::string_view();
+}
+
+const char* Regex::engine() const {
+    if (toks_.empty()) return "empty";
+    return literal_only_ ? "literal" : use_dfa_ ? "dfa" : "backtrack";
+}
+
+// The DFA cache is written to while matching, so each thread keeps its own
+// per Regex. Caches are looked up by serial number, not address, so a new
+// Regex allocated where an old one lived never inherits a stale cache.
+Dfa& Regex::dfa() const {
+    struct Entry { uint64_t serial; std::unique_ptr<Dfa> dfa; };
+    thread_local std::vector<Entry> cache;
+    for (auto& e : cache){
+        if (e.serial == serial_) return *e.dfa;
+    }
+    if (cache.size() >= 8) cache.erase(cache.begin()); // forget the oldest
+    cache.push_back({serial_, std::make_unique<Dfa>(prog_)});
+    return *cache.back().dfa;
+}
+
+bool Regex::match(std::string_view input_line) const {
+    if(toks_.empty()) return true; //empty pattern matches trivalliy
+    return match_line(input_line, nullptr);
+}
+
+bool Regex::match_line(std::string_view line, ScanStats* stats) const {
+    if (use_dfa_) return dfa().match(line);
+    switch (backtrack_->match(line)){
+        case Backtracker::Outcome::Match: return true;
+        case Backtracker::Outcome::NoMatch: return false;
+        case Backtracker::Outcome::OutOfBudget: break;
+    }
+    if (stats) ++stats->gave_up;
+    return false;
+}
+
+bool Regex::find(std::string_view line, size_t from, bool longest, Span& out,
+                 ScanStats* stats) const {
+    if (literal_only_){
+        size_t hit = prefilter_->find(line, from);
+        if (hit == std::string_view::npos) return false;
+        out = {hit, hit + prefilter_->needle().size()};
+        return true;
+    }
+    if (use_dfa_) return PikeVm(prog_).find(line, from, longest, out);
+    switch (backtrack_->find(line, from, longest, &out)){
+        case Backtracker::Outcome::Match: return true;
+        case Backtracker::Outcome::NoMatch: return false;
+        case Backtracker::Outcome::OutOfBudget: break;
+    }
+    if (stats) ++stats->gave_up;
+    return false;
+}
+
+size_t Regex::scan(std::string_view buf, size_t from, ScanStats* stats) const {
+    if (from >= buf.size()) return std::string_view::npos;
+    if (toks_.empty()) return from;
+    if (!prefilter_) return scan_lines(buf, from, stats);
+
+    const char* p = buf.data();
+    size_t n = buf.size();
+    while (from < n){
+        size_t hit = prefilter_->find(buf, from);
+        if (hit == std::string_view::npos){
+            if (stats){
+                stats->lines_skipped += std::count(p + from, p + n, '\n') + (p[n - 1] != '\n');
+            }
+            return std::string_view::npos;
+        }
+        const void* prev = memrchr(p + from, '\n', hit - from);
+        size_t start = prev ? static_cast<const char*>(prev) - p + 1 : from;
+        if (stats){
+            stats->lines_skipped += std::count(p + from, p + start, '\n');
+            ++stats->candidates;
+        }
+        if (literal_only_) return hit;
+
+        // only the candidate line goes through the engine
+        const void* nl = std::memchr(p + hit, '\n', n - hit);
+        size_t end = nl ? static_cast<const char*>(nl) - p : n;
+        size_t found = scan_lines(buf.substr(0, end), start, stats);
+        if (found != std::string_view::npos) return found;
+        if (stats) ++stats->rejected;
+        from = end + 1;
+    }
+    return std::string_view::npos;
+}
+
+size_t Regex::scan_lines(std::string_view buf, size_t from, ScanStats* stats) const {
+    if (use_dfa_) return dfa().scan(buf, from);
+
+    // backtracking matcher works one line at a time
+    const char* p = buf.data();
+    size_t n = buf.size();
+    while (from < n){
+        const void* nl = std::memchr(p + from, '\n', n - from);
+        size_t end = nl ? static_cast<const char*>(nl) - p : n;
+        if (match_line(buf.substr(from, end - from), stats)) return from;
+        from = end + 1;
+    }
+    return std::string_view::npos;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+#include "grepcore.hpp"
+#include "prog.hpp"
+
+class Backtracker;
+class Dfa;
+class LiteralSearcher;
+
+enum class TokenType {
+    Digit, // \d match 0-9
+    WordChar, // \w match [A-Za-z0-9_]
+    CharClass, // [abc] match a, b, or c
+    NegCharClass, // [^abc] match anything but a, b, or c
+    Literal, // match any literal character
+    StartAnchor, // force the match at the start only
+    EndAnchor, // for the match at the end
+    PlusQuantifier, // one or more
+    QuestionQuantifier, // zero or one
+    StarQuantifier, // zero or more
+    CountQuantifier, // {n}, {n,}, {,m} or {n,m}
+    AnyChar,
+    LeftParen, // (
+    RigthParen, // )
+    Alternation, // |
+    BackRef // \1 backreference: reuse a captured group
+};
+
+struct Token
+{
+    TokenType type;
+    std::string data; //for Literal and BackRef
+    std::bitset<256> set{}; // bytes a single-character token accepts
+    // quantifiers: how many times the element before may repeat (max is
+    // kUnbounded for no limit), and whether as few as possible ('?' after it)
+    uint32_t min = 0;
+    uint32_t max = 0;
+    bool lazy = false;
+};
+
+inline bool is_quantifier(TokenType t){
+    return t == TokenType::PlusQuantifier || t == TokenType::QuestionQuantifier ||
+           t == TokenType::StarQuantifier || t == TokenType::CountQuantifier;
+}
+
+std::vector<Token> tokenize(const std::string& pattern);
+
+using grepcore::ScanStats;
+using grepcore::Span;
+
+struct RegexOptions {
+    // backtracking steps allowed per line before the line is given up on and
+    // counted as not matching; 0 = unlimited
+    uint64_t step_budget = 10'000'000;
+    // -i: letters match either case (ASCII only), folded into the byte sets
+    // when compiling, so matching itself costs nothing extra
+    bool ignore_case = false;
+};
+
+// A pattern compiled once up front. Besides the tokens it keeps the tables the
+// matcher used to rebuild on every attempt: group ids, the matching ')' of each
+// '(' and the top-level '|' split of every group body.
+//
+// Patterns without backreferences are also compiled to an NFA and matched by
+// a lazily built DFA in linear time; only patterns using \1-style references
+// go through the backtracking matcher, which gives up on a line after
+// RegexOptions::step_budget steps. A Regex is immutable once built and can
+// be shared between threads: each thread grows its own DFA cache.
+class Regex {
+public:
+    using Parts = std::vector<std::pair<size_t, size_t>>;
+
+    explicit Regex(const std::string& pattern, const RegexOptions& opts = {});
+    // any of the patterns: one automaton for their alternation
+    explicit Regex(const std::vector<std::string>& patterns, const RegexOptions& opts = {});
+    ~Regex();
+    Regex(const Regex&) = delete;
+    Regex& operator=(const Regex&) = delete;
+
+    bool match(std::string_view line) const;
+
+    // Search a buffer of '\n'-separated lines, starting at the line that
+    // begins at `from`. Returns an offset inside the first matching line (a
+    // line's '\n' belongs to it) or npos; lines are only delimited here when
+    // the engine cannot scan across them itself.
+    //
+    // When the pattern contains a required literal, regions without it are
+    // skipped before the engine runs; `stats`, if given, counts how often.
+    size_t scan(std::string_view buf, size_t from = 0, ScanStats* stats = nullptr) const;
+
+    // Leftmost match in one line starting at or after `from` (anchors see
+    // the whole line): the longest there, or with `longest` false the one a
+    // backtracking matcher reaches first. Backreference-free patterns run
+    // on a PikeVm, the others on the Backtracker.
+    bool find(std::string_view line, size_t from, bool longest, Span& out,
+              ScanStats* stats = nullptr) const;
+
+    bool has_prefilter() const { return prefilter_ != nullptr; }
+    // the literal searched for before the engine runs, "" without one
+    std::string_view prefilter_literal() const;
+    // how lines are matched: "literal" (the prefilter alone), "dfa",
+    // "backtrack", or "empty" when every line matches
+    const char* engine() const;
+
+    const std::vector<Token>& tokens() const { return toks_; }
+    int max_gid() const { return max_gid_; }
+    int gid_at_open(size_t open_j) const { return gid_at_open_[open_j]; }
+    size_t rparen(size_t open_j) const { return rparen_[open_j]; }
+
+    // branches of the slice [L, R) if it is a whole group body (or the whole
+    // pattern) containing a top-level '|', nullptr otherwise
+    const Parts* alternatives(size_t L, size_t R) const {
+        if (slice_end_[L] != R || alts_[L].size() < 2) return nullptr;
+        return &alts_[L];
+    }
+
+private:
+    bool match_line(std::string_view line, ScanStats* stats) const;
+    size_t scan_lines(std::string_view buf, size_t from, ScanStats* stats) const;
+    Dfa& dfa() const;
+
+    std::vector<Token> toks_;
+    std::vector<int> gid_at_open_;
+    std::vector<size_t> rparen_;     // index of the matching ')' for each '('
+    std::vector<size_t> slice_end_;  // body end for L == 0 and L == '(' + 1
+    std::vector<Parts> alts_;        // top-level branches of those bodies
+    int max_gid_ = 0;
+
+    Prog prog_;
+    bool use_dfa_ = false;           // false when the pattern has backrefs
+    uint64_t serial_ = 0;            // keys the per-thread DFA caches
+    std::unique_ptr<Backtracker> backtrack_; // only when the DFA can't be used
+
+    std::unique_ptr<LiteralSearcher> prefilter_; // longest required literal
+    bool literal_only_ = false;      // the pattern is just that literal
+};
@@ -0,0 +1,594 @@
+#include "search.hpp"
+#include "diag.hpp"
+#include "index.hpp"
+#include "input.hpp"
+#include "thread_pool.hpp"
+#include "walk.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <system_error>
+
+using grepcore::ScanStats;
+
+void Output::write(std::string_view s, bool first){
+    if (s.empty()) return;
+    std::lock_guard<std::mutex> lk(m_);
+    if (first && wrote_) std::cout << sep_;
+    wrote_ = true;
+    std::cout.write(s.data(), s.size());
+    if (line_buffered_) std::cout.flush();
+}
+
+// end of the line containing offset `at` (the offset of its '\n')
+static size_t line_end(std::string_view buf, size_t at){
+    const void* nl = std::memchr(buf.data() + at, '\n', buf.size() - at);
+    return nl ? static_cast<const char*>(nl) - buf.data() : buf.size();
+}
+
+// GNU grep's default GREP_COLORS
+static constexpr const char* kMatchColor = "01;31";
+static constexpr const char* kNameColor = "35";
+static constexpr const char* kOffsetColor = "32";
+static constexpr const char* kSepColor = "36";
+
+static void append_colored(std::string& out, bool color, const char* sgr, std::string_view text){
+    if (color){ out += "\33["; out += sgr; out += "m\33[K"; }
+    out += text;
+    if (color) out += "\33[m\33[K";
+}
+
+// -z: switch `in` to its decoded bytes if it is compressed; false (and
+// reported) if it is in a format this build can't read
+static bool start_decoding(Input& in, const std::string& name, const Options& opt){
+    if (!opt.decompress || in.decode()) return true;
+    report(name, in.error());
+    return false;
+}
+
+// a compressed input that turned out to be damaged is searched up to there
+static void check_decoded(const Input& in, const std::string& name){
+    if (in.format() != Decompressor::Format::None && !in.error().empty()) report(name, in.error());
+}
+
+// first `lines` lines of `text`
+static size_t prefix_lines(std::string_view text, uint64_t lines){
+    size_t end = 0;
+    while (lines-- && end < text.size()) end = line_end(text, end) + 1;
+    return std::min(end, text.size());
+}
+
+Searcher::Searcher(const grepcore::Matcher& pats, const Options& opt, Output& out)
+    : pats_(pats), opt_(opt), out_(out), pool_(std::make_unique<ThreadPool>(opt.jobs)) {
+    print_lines_ = !(opt.count || opt.files_with_matches || opt.quiet);
+    plain_lines_ = !(opt.only_matching || opt.byte_offset || opt.color);
+    limit_ = (opt.files_with_matches || opt.quiet) ? 1 : opt.max_count;
+    context_ = print_lines_ && opt.context;
+    if (context_){
+        std::string sep;
+        append_colored(sep, opt.color, kSepColor, "--");
+        out_.set_separator(sep + '\n');
+    }
+}
+
+Searcher::~Searcher() = default;
+
+// The engines scan whole buffers; a line is only cut out of the buffer once
+// it is known to match, and only if it is printed: counting just skips to
+// the end of each matching line.
+uint64_t Searcher::grep_buffer(std::string_view buf, size_t from, uint64_t offset,
+                               const std::string& prefix, std::string& out, ScanStats& stats,
+                               uint64_t limit, Context* ctx){
+    uint64_t found = 0;
+    size_t pos = from, hit;
+    grepcore::Scanner cursor(pats_, buf);
+    while (found < limit && (hit = cursor.next(pos, &stats)) != std::string_view::npos){
+        size_t end = line_end(buf, hit);
+        if (print_lines_){
+            const void* prev = memrchr(buf.data() + pos, '\n', hit - pos);
+            size_t start = prev ? static_cast<const char*>(prev) - buf.data() + 1 : pos;
+            if (ctx) print_context(buf, offset, start, true, prefix, out, *ctx);
+            if (plain_lines_){
+                if (!prefix.empty()){ out += prefix; out += ':'; }
+                out.append(buf.data() + start, end - start);
+                out += '\n';
+            } else {
+                print_line(buf.substr(start, end - start), offset + start, prefix, out);
+            }
+            if (ctx){
+                ctx->printed = true;
+                ctx->printed_end = offset + end + 1;
+                ctx->after_left = opt_.after_context;
+            }
+        }
+        ++found;
+        pos = end + 1;
+    }
+    // trailing context, also after the -m'th match
+    if (ctx) print_context(buf, offset, buf.size(), false, prefix, out, *ctx);
+    return found;
+}
+
+void Searcher::print_context(std::string_view buf, uint64_t offset, size_t to, bool leading,
+                             const std::string& prefix, std::string& out, Context& ctx) const {
+    // nothing before `p` is printed again
+    size_t p = ctx.printed_end > offset ? std::min<uint64_t>(ctx.printed_end - offset, to) : 0;
+    for (; ctx.after_left && p < to; --ctx.after_left){
+        size_t e = line_end(buf, p);
+        print_context_line(buf.substr(p, e - p), offset + p, prefix, out);
+        p = std::min(e + 1, buf.size());
+        ctx.printed_end = offset + p;
+    }
+    if (!leading) return;
+
+    size_t b = to;
+    for (uint64_t k = 0; k < opt_.before_context && b > p; ++k){
+        const void* nl = memrchr(buf.data() + p, '\n', b - 1 - p);
+        b = nl ? static_cast<const char*>(nl) - buf.data() + 1 : p;
+    }
+    if (ctx.printed && offset + b > ctx.printed_end){
+        append_colored(out, opt_.color, kSepColor, "--");
+        out += '\n';
+    }
+    while (b < to){
+        size_t e = line_end(buf, b);
+        print_context_line(buf.substr(b, e - b), offset + b, prefix, out);
+        b = e + 1;
+    }
+}
+
+void Searcher::print_context_line(std::string_view line, uint64_t offset, const std::string& prefix,
+                                  std::string& out) const {
+    if (opt_.only_matching) return; // -o keeps the "--" between groups, nothing else
+    if (!prefix.empty()){
+        append_colored(out, opt_.color, kNameColor, prefix);
+        append_colored(out, opt_.color, kSepColor, "-");
+    }
+    if (opt_.byte_offset){
+        append_colored(out, opt_.color, kOffsetColor, std::to_string(offset));
+        append_colored(out, opt_.color, kSepColor, "-");
+    }
+    out += line;
+    out += '\n';
+}
+
+// The matches are found again within the line, all in one left to right
+// pass; with -o only they are printed, each with the offset of its start.
+void Searcher::print_line(std::string_view line, uint64_t offset, const std::string& prefix,
+                          std::string& out) const {
+    const bool color = opt_.color;
+    auto lead = [&](uint64_t at){
+        if (!prefix.empty()){
+            append_colored(out, color, kNameColor, prefix);
+            append_colored(out, color, kSepColor, ":");
+        }
+        if (opt_.byte_offset){
+            append_colored(out, color, kOffsetColor, std::to_string(at));
+            append_colored(out, color, kSepColor, ":");
+        }
+    };
+
+    if (!opt_.only_matching){
+        lead(offset);
+        if (!color){
+            out += line;
+            out += '\n';
+            return;
+        }
+    }
+    size_t done = 0;
+    for (grepcore::Matches ms(pats_, line); auto m = ms.next(); ){
+        if (m->begin == m->end) continue; // nothing to show
+        std::string_view text = line.substr(m->begin, m->end - m->begin);
+        if (opt_.only_matching){
+            lead(offset + m->begin);
+            append_colored(out, color, kMatchColor, text);
+            out += '\n';
+            continue;
+        }
+        out += line.substr(done, m->begin - done);
+        append_colored(out, color, kMatchColor, text);
+        done = m->end;
+    }
+    if (!opt_.only_matching){
+        out += line.substr(done);
+        out += '\n';
+    }
+}
+
+// Split `buf` into kPieceSize pieces ending on a '\n' and match them on the
+// pool. At most two pieces per thread are in flight; the oldest one is
+// waited for and released first, which keeps the output in input order and
+// memory bounded however large the buffer is. Once `limit` lines are in,
+// pieces still queued are dropped unsearched.
+uint64_t Searcher::grep_pieces(std::string_view buf, uint64_t offset, const std::string& prefix,
+                               std::string& out, ScanStats& stats, bool flush, uint64_t limit){
+    struct Piece {
+        TaskGroup group;
+        std::string out;
+        ScanStats stats;
+        uint64_t found = 0;
+    };
+    std::deque<std::unique_ptr<Piece>> inflight;
+    std::atomic<bool> enough{false};
+    uint64_t found = 0;
+
+    auto release = [&]{
+        Piece& p = *inflight.front();
+        pool_->wait(p.group);
+        if (found < limit){
+            uint64_t take = std::min(p.found, limit - found);
+            std::string_view text = p.out;
+            if (take < p.found) text = text.substr(0, prefix_lines(text, take));
+            found += take;
+            stats += p.stats;
+            if (flush) out_.write(text);
+            else out += text;
+        }
+        if (found >= limit) enough = true;
+        inflight.pop_front();
+    };
+
+    size_t begin = 0, n = buf.size();
+    while (begin < n && !enough && !stopped()){
+        size_t end = n;
+        if (n - begin > kPieceSize){
+            const void* nl = std::memchr(buf.data() + begin + kPieceSize, '\n',
+                                         n - begin - kPieceSize);
+            if (nl) end = static_cast<const char*>(nl) - buf.data() + 1;
+        }
+        auto piece = std::make_unique<Piece>();
+        Piece* p = piece.get();
+        std::string_view part = buf.substr(begin, end - begin);
+        uint64_t at = offset + begin;
+        pool_->submit(p->group, [this, p, part, at, &prefix, &enough, limit]{
+            if (enough || stopped()) return;
+            p->found = grep_buffer(part, 0, at, prefix, p->out, p->stats, limit, nullptr);
+            if (p->found) note_match();
+        });
+        inflight.push_back(std::move(piece));
+        if (inflight.size() >= 2 * pool_->size()) release();
+        begin = end;
+    }
+    while (!inflight.empty()) release();
+    return found;
+}
+
+bool Searcher::grep_input(Input& in, const std::string& name, bool show_name, std::string& out,
+                          ScanStats& stats, bool flush){
+    const std::string prefix = show_name ? name : "";
+    // a piece's output is cut back to whole matching lines when it holds
+    // more than -m wants, which -o's one line per match doesn't allow; and
+    // context runs from one piece into the next
+    const bool split = pool_->size() > 1 && !context_ &&
+                       !(opt_.only_matching && limit_ != UINT64_MAX);
+    Context context;
+    Context* ctx = context_ ? &context : nullptr;
+    if (ctx) in.set_history(opt_.before_context);
+    uint64_t found = 0, offset = 0;
+    bool first = true;
+    auto emit = [&]{
+        if (out.empty()) return;
+        out_.write(out, first);
+        first = false;
+        out.clear();
+    };
+    // --stats: time is split at every buffer into waiting for it and the rest
+    const bool timed = opt_.stats != Options::Stats::None;
+    InputStats is;
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point lap_start = timed ? Clock::now() : Clock::time_point();
+    auto lap = [&](uint64_t& ns){
+        if (!timed) return;
+        Clock::time_point now = Clock::now();
+        ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - lap_start).count();
+        lap_start = now;
+    };
+    std::string_view chunk;
+    while ((found < limit_ || (ctx && ctx->after_left)) && !stopped() && in.next(chunk)){
+        lap(is.read_ns);
+        if (timed){
+            is.bytes += chunk.size();
+            is.lines += std::count(chunk.begin(), chunk.end(), '\n');
+            if (!chunk.empty() && chunk.back() != '\n') ++is.lines; // the last one, at EOF
+        }
+        uint64_t left = limit_ - found;
+        if (split && chunk.size() > 2 * kPieceSize){
+            found += grep_pieces(chunk, offset, prefix, out, stats, flush, left);
+        } else if (ctx){
+            // the -B lines kept from the buffer before sit right in front of it
+            std::string_view kept = in.history();
+            std::string_view buf(chunk.data() - kept.size(), kept.size() + chunk.size());
+            found += grep_buffer(buf, kept.size(), offset - kept.size(), prefix, out, stats, left, ctx);
+        } else {
+            found += grep_buffer(chunk, 0, offset, prefix, out, stats, left, nullptr);
+        }
+        offset += chunk.size();
+        if (found) note_match();
+        if (flush) emit();
+        lap(is.match_ns);
+    }
+
+    print_summary(name, show_name, found, out);
+    if (flush) emit();
+    if (timed){
+        lap(is.read_ns); // the read that found the end
+        is.inputs = 1;
+        std::lock_guard<std::mutex> lk(stats_m_);
+        input_stats_ += is;
+    }
+    return found > 0;
+}
+
+void Searcher::print_summary(const std::string& name, bool show_name, uint64_t found,
+                             std::string& out) const {
+    if (opt_.quiet) {}
+    else if (opt_.files_with_matches){
+        if (found){
+            append_colored(out, opt_.color, kNameColor, name);
+            out += '\n';
+        }
+    }
+    else if (opt_.count){
+        if (show_name){
+            append_colored(out, opt_.color, kNameColor, name);
+            append_colored(out, opt_.color, kSepColor, ":");
+        }
+        out += std::to_string(found);
+        out += '\n';
+    }
+}
+
+void Searcher::note_match(){
+    any_matched_ = true;
+    if (opt_.quiet) done_ = true; // the exit status is all that is left to find out
+}
+
+void Searcher::merge(const ScanStats& s){
+    std::lock_guard<std::mutex> lk(stats_m_);
+    stats_ += s;
+}
+
+ScanStats Searcher::stats() const {
+    std::lock_guard<std::mutex> lk(stats_m_);
+    return stats_;
+}
+
+// a JSON string; bytes from 0x80 up are copied as they are
+static std::string json_string(std::string_view s){
+    std::string out = "\"";
+    for (unsigned char c : s){
+        if (c == '"' || c == '\\'){
+            out += '\\';
+            out += c;
+        } else if (c < 0x20){
+            char esc[8];
+            std::snprintf(esc, sizeof esc, "\\u%04x", c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    return out + '"';
+}
+
+void Searcher::print_stats(std::ostream& os) const {
+    ScanStats scan;
+    InputStats in;
+    {
+        std::lock_guard<std::mutex> lk(stats_m_);
+        scan = stats_;
+        in = input_stats_;
+    }
+    const grepcore::EngineCounters work = grepcore::engine_counters();
+    const std::vector<grepcore::EnginePlan> plan = pats_.plan();
+    const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    // of the lines the prefilter let through, the share that did match
+    const double hit_rate = scan.candidates
+        ? double(scan.candidates - scan.rejected) / double(scan.candidates) : 0;
+
+    std::ostringstream o;
+    o << std::fixed << std::setprecision(3);
+    if (opt_.stats == Options::Stats::Json){
+        std::vector<const grepcore::EnginePlan*> engine_of(opt_.patterns.size());
+        for (const auto& e : plan){
+            for (size_t k : e.patterns) engine_of[k] = &e;
+        }
+        o << "{\"patterns\":[";
+        for (size_t k = 0; k < opt_.patterns.size(); ++k){
+            const grepcore::EnginePlan& e = *engine_of[k];
+            o << (k ? "," : "") << "{\"pattern\":" << json_string(opt_.patterns[k])
+              << ",\"engine\":" << json_string(e.engine) << ",\"prefilter\":"
+              << (e.prefilter.empty() ? "null" : json_string(e.prefilter)) << "}";
+        }
+        o << "],\"inputs\":" << in.inputs << ",\"bytes\":" << in.bytes << ",\"lines\":" << in.lines
+          << ",\"prefilter\":{\"lines_skipped\":" << scan.lines_skipped
+          << ",\"candidates\":" << scan.candidates << ",\"rejected\":" << scan.rejected
+          << ",\"hit_rate\":" << hit_rate << "}"
+          << ",\"engine\":{\"starts\":" << work.starts << ",\"backtrack_steps\":" << work.steps
+          << ",\"dfa_states\":" << work.dfa_states << ",\"dfa_flushes\":" << work.dfa_flushes
+          << ",\"gave_up\":" << scan.gave_up << "}"
+          << ",\"seconds\":{\"wall\":" << wall << ",\"read\":" << in.read_ns / 1e9
+          << ",\"match\":" << in.match_ns / 1e9 << "}}\n";
+    } else {
+        // each engine with a prefilter counts the lines it skipped itself
+        size_t prefiltered = std::count_if(plan.begin(), plan.end(),
+                                           [](const auto& e){ return !e.prefilter.empty(); });
+        o << "stats:\n";
+        for (const auto& e : plan){
+            // pattern numbers count from 1, in the order they were given
+            o << "  " << e.engine << ": " << e.patterns.size()
+              << (e.patterns.size() == 1 ? " pattern (" : " patterns (");
+            for (size_t i = 0; i < e.patterns.size() && i < 10; ++i){
+                o << (i ? " #" : "#") << e.patterns[i] + 1;
+            }
+            o << (e.patterns.size() > 10 ? " ...)" : ")");
+            if (!e.prefilter.empty()) o << ", prefilter " << json_string(e.prefilter);
+            o << "\n";
+        }
+        o << "  read: " << in.inputs << " inputs, " << in.bytes << " bytes, " << in.lines << " lines\n"
+          << "  prefilter: " << scan.lines_skipped << " lines skipped, " << scan.candidates
+          << " candidates, " << scan.rejected << " rejected (" << std::setprecision(1)
+          << 100 * hit_rate << "% matched)" << std::setprecision(3)
+          << (prefiltered > 1 ? ", summed over " + std::to_string(prefiltered) + " engines\n" : "\n")
+          << "  engine work: " << work.starts << " start offsets, " << work.steps
+          << " backtracking steps, " << work.dfa_states << " dfa states, " << work.dfa_flushes
+          << " cache flushes, " << scan.gave_up << " lines given up\n"
+          << "  time: " << wall << "s wall, " << in.read_ns / 1e9 << "s reading, "
+          << in.match_ns / 1e9 << "s matching (summed over threads)\n";
+    }
+    os << o.str() << std::flush;
+}
+
+void Searcher::search_stdin(){
+    Input in(0);
+    // with threads to feed, read stdin in batches worth splitting
+    if (pool_->size() > 1) in.set_batch(2 * kPieceSize * pool_->size());
+    const std::string name = "(standard input)";
+    if (!start_decoding(in, name, opt_)) return;
+    std::string out;
+    ScanStats stats;
+    grep_input(in, name, false, out, stats, true);
+    check_decoded(in, name);
+    merge(stats);
+}
+
+void Searcher::search_file(const std::string& path, bool show_name){
+    if (stopped()) return;
+    auto in = Input::open(path.c_str());
+    if (!in){
+        report(path, std::system_category().message(errno));
+        return;
+    }
+    if (!start_decoding(*in, path, opt_)) return;
+    std::string out;
+    ScanStats stats;
+    grep_input(*in, path, show_name, out, stats, true);
+    check_decoded(*in, path);
+    merge(stats);
+}
+
+// A file found by -r: what can't be opened is reported and skipped, and so
+// are binary files unless -a. One the index rules out counts as searched,
+// without a match, unless -r would have skipped it anyway. `at` is its
+// directory if the walk found it there, else the path is opened as it is.
+void Searcher::search_one(const std::string& path, const Walker::DirFdPtr& at, std::string& out,
+                          ScanStats& stats){
+    if (stopped()) return;
+    if (index_){
+        switch (index_->check(path)){
+            case TrigramIndex::Verdict::Search: break;
+            case TrigramIndex::Verdict::NoMatch: print_summary(path, true, 0, out); return;
+            case TrigramIndex::Verdict::Skip: return;
+        }
+    }
+    auto in = at ? Input::open(at->fd(), Walker::base_name(path)) : Input::open(path.c_str());
+    if (!in){
+        report(path, std::system_category().message(errno));
+        return;
+    }
+    if (!start_decoding(*in, path, opt_)) return;
+    if (!opt_.text && in->binary()) return;
+    grep_input(*in, path, true, out, stats, false);
+    check_decoded(*in, path);
+}
+
+namespace {
+
+// Releases per-file output in submission order, whatever order the files
+// finish in.
+class OrderedSink {
+public:
+    explicit OrderedSink(Output& out) : out_(out) {}
+
+    void complete(size_t seq, std::string text){
+        std::lock_guard<std::mutex> lk(m_);
+        ready_.emplace(seq, std::move(text));
+        while (!ready_.empty() && ready_.begin()->first == next_){
+            out_.write(ready_.begin()->second, true);
+            ready_.erase(ready_.begin());
+            ++next_;
+        }
+    }
+
+    size_t released(){
+        std::lock_guard<std::mutex> lk(m_);
+        return next_;
+    }
+
+private:
+    Output& out_;
+    std::mutex m_;
+    std::map<size_t, std::string> ready_;
+    size_t next_ = 0;
+};
+
+} // namespace
+
+void Searcher::search_tree(const std::vector<std::string>& roots){
+    ThreadPool& pool = *pool_;
+    const Walker walker(opt_);
+
+    auto search_task = [this](std::string path, Walker::DirFdPtr at, auto done){
+        return [this, path = std::move(path), at = std::move(at), done]{
+            std::string out;
+            ScanStats stats;
+            search_one(path, at, out, stats);
+            done(std::move(out));
+            merge(stats);
+        };
+    };
+
+    if (opt_.ordered || opt_.jobs == 1){
+        // Sequential traversal order: this thread walks the tree and numbers
+        // the files, the pool searches them, the sink puts them back in line.
+        // At most `window` finished files are held back at any time.
+        OrderedSink sink(out_);
+        size_t seq = 0;
+        size_t window = opt_.jobs == 1 ? 1 : 64 * opt_.jobs;
+        auto submit = [&](std::string path, const Walker::DirFdPtr& at){
+            size_t id = seq++;
+            pool.submit(search_task(std::move(path), at, [&sink, id](std::string out){
+                sink.complete(id, std::move(out));
+            }));
+            while (seq - sink.released() >= window && pool.help()) {}
+        };
+        // depth first, each subdirectory opened relative to its parent
+        Walker::DirFn descend = [&](const Walker::DirPtr& dir, const Walker::DirFdPtr& at){
+            if (!stopped()) walker.list(dir, at, submit, descend);
+        };
+        for (const auto& root : roots){
+            if (stopped()) break;
+            if (auto dir = walker.root(root)) descend(dir, nullptr);
+            else submit(root, nullptr);
+        }
+        pool.wait();
+        return;
+    }
+
+    // Unordered: directories are tasks too, so the walk itself is spread
+    // over the pool; whichever file finishes first is written first. A
+    // queued directory keeps its parent open to be opened in.
+    auto write_out = [this](std::string out){ out_.write(out, true); };
+    Walker::FileFn on_file = [&](std::string path, const Walker::DirFdPtr& at){
+        pool.submit(search_task(std::move(path), at, write_out));
+    };
+    Walker::DirFn descend = [&](const Walker::DirPtr& dir, const Walker::DirFdPtr& at){
+        pool.submit([&, dir, at]{
+            if (!stopped()) walker.list(dir, at, on_file, descend);
+        });
+    };
+    for (const auto& root : roots){
+        if (auto dir = walker.root(root)) descend(dir, nullptr);
+        else on_file(root, nullptr);
+    }
+    pool.wait();
+}
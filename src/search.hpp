@@ -0,0 +1,147 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "grepcore.hpp"
+#include "options.hpp"
+#include "walk.hpp"
+
+class Input;
+class ThreadPool;
+class TrigramIndex;
+
+// Serializes writes to stdout. Searches collect the lines of one file in
+// their own buffer and hand over complete buffers, so output from parallel
+// searches never interleaves within a file. stdout is block-buffered; with
+// `line_buffered` every write is flushed as soon as it is made.
+class Output {
+public:
+    explicit Output(bool line_buffered = false) : line_buffered_(line_buffered) {}
+
+    // `first` marks the first output of an input: the separator goes before
+    // it if anything was written already
+    void write(std::string_view s, bool first = false);
+
+    // what to put between the output of two inputs (-A/-B/-C's "--")
+    void set_separator(std::string sep) { sep_ = std::move(sep); }
+
+private:
+    std::mutex m_;
+    bool line_buffered_;
+    bool wrote_ = false;
+    std::string sep_;
+};
+
+// --stats: what the searches read and where their time went, summed over
+// the inputs. Inputs searched at once on several threads add up, so the
+// times can exceed the wall clock.
+struct InputStats {
+    uint64_t inputs = 0;
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    uint64_t read_ns = 0;    // waiting for input: read() and decompression
+    uint64_t match_ns = 0;   // matching and writing out what matched; for a
+                             // mapped file this includes its page faults
+
+    InputStats& operator+=(const InputStats& o){
+        inputs += o.inputs;
+        bytes += o.bytes;
+        lines += o.lines;
+        read_ns += o.read_ns;
+        match_ns += o.match_ns;
+        return *this;
+    }
+};
+
+// Runs the compiled patterns over stdin, files and directory trees. With
+// opt.jobs > 1 a large buffer is also cut at line boundaries into pieces
+// that are matched on several threads; their output is put back together in
+// input order, so it is byte-identical to a sequential run.
+class Searcher {
+public:
+    static constexpr size_t kPieceSize = 8 << 20;
+
+    Searcher(const grepcore::Matcher& pats, const Options& opt, Output& out);
+    ~Searcher();
+
+    void search_stdin();
+    void search_file(const std::string& path, bool show_name);
+
+    // -r: walk every root with opt.jobs threads; files are searched in
+    // parallel and each file's lines are written out together
+    void search_tree(const std::vector<std::string>& roots);
+
+    // --index: files of the tree the index rules out are not read at all
+    void set_index(const TrigramIndex* index) { index_ = index; }
+
+    bool any_matched() const { return any_matched_; }
+    // -q found its match: nothing left to search
+    bool stopped() const { return done_.load(std::memory_order_relaxed); }
+    grepcore::ScanStats stats() const;
+
+    // --stats: the summary of everything searched so far, as opt.stats
+    // asks; call it once the searches are done
+    void print_stats(std::ostream& os) const;
+
+private:
+    // -A/-B/-C state of one input, carried from buffer to buffer: the
+    // context is printed straight out of the buffers, by offset
+    struct Context {
+        uint64_t printed_end = 0;  // input offset just past the last line printed
+        bool printed = false;      // any line printed yet
+        uint64_t after_left = 0;   // trailing lines still owed to the last match
+    };
+
+    // Matching lines of `in` are appended to `out` (or, with -c / -l, its
+    // count or name once at the end); with `flush` set they are written
+    // after every buffer instead. At most limit_ lines are looked for.
+    bool grep_input(Input& in, const std::string& name, bool show_name, std::string& out,
+                    grepcore::ScanStats& stats, bool flush);
+    // both return the number of matching lines found, at most `limit`;
+    // `offset` is where buf starts in the input. grep_buffer() searches from
+    // `from` on; the lines before it are there for -B only.
+    uint64_t grep_buffer(std::string_view buf, size_t from, uint64_t offset,
+                         const std::string& prefix, std::string& out, grepcore::ScanStats& stats,
+                         uint64_t limit, Context* ctx);
+    uint64_t grep_pieces(std::string_view buf, uint64_t offset, const std::string& prefix,
+                         std::string& out, grepcore::ScanStats& stats, bool flush, uint64_t limit);
+    // what -c and -l print for a file once it has been searched
+    void print_summary(const std::string& name, bool show_name, uint64_t found,
+                       std::string& out) const;
+    // one matching line as -o, -b and --color want it
+    void print_line(std::string_view line, uint64_t offset, const std::string& prefix,
+                    std::string& out) const;
+    // The context lines of buf before `to`: what the last match is still
+    // owed, then with `leading` the "--" and -B lines of the match at `to`.
+    void print_context(std::string_view buf, uint64_t offset, size_t to, bool leading,
+                       const std::string& prefix, std::string& out, Context& ctx) const;
+    void print_context_line(std::string_view line, uint64_t offset, const std::string& prefix,
+                            std::string& out) const;
+    void note_match();
+    void search_one(const std::string& path, const Walker::DirFdPtr& at, std::string& out,
+                    grepcore::ScanStats& stats);
+    void merge(const grepcore::ScanStats& s);
+
+    const grepcore::Matcher& pats_;
+    const Options& opt_;
+    Output& out_;
+    std::unique_ptr<ThreadPool> pool_;
+    const TrigramIndex* index_ = nullptr;
+    bool print_lines_ = true;        // false for -c, -l and -q
+    bool plain_lines_ = true;        // whole lines, no -o, -b or --color
+    bool context_ = false;           // -A/-B/-C, when lines are printed
+    uint64_t limit_ = UINT64_MAX;    // matching lines wanted per file
+    std::atomic<bool> any_matched_{false};
+    std::atomic<bool> done_{false};
+    mutable std::mutex stats_m_;
+    grepcore::ScanStats stats_;
+    InputStats input_stats_;
+    std::chrono::steady_clock::time_point started_ = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,122 @@
+#include "thread_pool.hpp"
+
+#include <chrono>
+
+// index of the deque owned by the current thread; the injection deque for
+// threads that are not pool workers
+static thread_local size_t tls_queue = static_cast<size_t>(-1);
+static thread_local const ThreadPool* tls_pool = nullptr;
+
+ThreadPool::ThreadPool(unsigned threads){
+    unsigned nworkers = threads > 1 ? threads - 1 : 0;
+    for (unsigned i = 0; i <= nworkers; ++i) queues_.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < nworkers; ++i){
+        workers_.emplace_back([this, i]{ worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    wait();
+    {
+        std::lock_guard<std::mutex> lk(sleep_m_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+size_t ThreadPool::self_queue() const {
+    return (tls_pool == this) ? tls_queue : workers_.size();
+}
+
+void ThreadPool::submit(Task task){
+    size_t q = self_queue();
+    pending_.fetch_add(1);
+    {
+        // count before publishing so queued_ never dips below zero
+        std::lock_guard<std::mutex> lk(sleep_m_);
+        queued_.fetch_add(1);
+    }
+    {
+        std::lock_guard<std::mutex> lk(queues_[q]->m);
+        queues_[q]->tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+void ThreadPool::submit(TaskGroup& group, Task task){
+    group.pending_.fetch_add(1);
+    submit([this, &group, task = std::move(task)]{
+        task();
+        if (group.pending_.fetch_sub(1) == 1){
+            std::lock_guard<std::mutex> lk(sleep_m_);
+            wake_.notify_all();
+        }
+    });
+}
+
+bool ThreadPool::try_run(size_t self){
+    Task task;
+    size_t n = queues_.size();
+    // own deque first (newest task), then steal the oldest from the others
+    if (self < n){
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> lk(own.m);
+        if (!own.tasks.empty()){
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    for (size_t k = 1; !task && k <= n; ++k){
+        Queue& victim = *queues_[(self + k) % n];
+        std::lock_guard<std::mutex> lk(victim.m);
+        if (!victim.tasks.empty()){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) return false;
+
+    queued_.fetch_sub(1);
+    task();
+    if (pending_.fetch_sub(1) == 1){
+        std::lock_guard<std::mutex> lk(sleep_m_);
+        wake_.notify_all(); // wake threads blocked in wait()
+    }
+    return true;
+}
+
+void ThreadPool::worker_loop(size_t self){
+    tls_queue = self;
+    tls_pool = this;
+    for (;;){
+        if (try_run(self)) continue;
+        std::unique_lock<std::mutex> lk(sleep_m_);
+        wake_.wait(lk, [&]{ return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) return;
+    }
+}
+
+bool ThreadPool::help(){
+    if (try_run(self_queue())) return true;
+    if (pending_ == 0) return false;
+    // everything left is running elsewhere: doze until something changes
+    std::unique_lock<std::mutex> lk(sleep_m_);
+    wake_.wait_for(lk, std::chrono::milliseconds(1),
+                   [&]{ return queued_ > 0 || pending_ == 0; });
+    return true;
+}
+
+void ThreadPool::wait(){
+    while (pending_ > 0) help();
+}
+
+void ThreadPool::wait(TaskGroup& group){
+    size_t self = self_queue();
+    while (!group.done()){
+        if (try_run(self)) continue;
+        std::unique_lock<std::mutex> lk(sleep_m_);
+        wake_.wait_for(lk, std::chrono::milliseconds(1),
+                       [&]{ return queued_ > 0 || group.done(); });
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tasks submitted through a TaskGroup can be waited for on their own, e.g.
+// the chunks of one file while other files keep the pool busy.
+class TaskGroup {
+public:
+    bool done() const { return pending_ == 0; }
+
+private:
+    friend class ThreadPool;
+    std::atomic<size_t> pending_{0};
+};
+
+// Fixed-size pool with one task deque per worker. A worker pushes and pops
+// at the back of its own deque (depth first, cache friendly) and, when that
+// runs dry, steals from the front of the others. Threads outside the pool
+// submit to a shared injection deque and can lend a hand from wait().
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    // `threads` counts the calling thread, so ThreadPool(1) starts no
+    // workers and everything runs inside wait()
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    void submit(TaskGroup& group, Task task);
+
+    // run or wait for one task; false if there was nothing to do
+    bool help();
+
+    // block until every submitted task (and what those spawned) has finished,
+    // running tasks on the calling thread meanwhile
+    void wait();
+
+    // block until the group's tasks have finished, helping meanwhile; safe
+    // to call from inside a task
+    void wait(TaskGroup& group);
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    size_t self_queue() const;
+    bool try_run(size_t self);
+    void worker_loop(size_t self);
+
+    std::vector<std::unique_ptr<Queue>> queues_; // one per worker + injection
+    std::vector<std::thread> workers_;
+
+    std::atomic<size_t> queued_{0};   // tasks sitting in some deque
+    std::atomic<size_t> pending_{0};  // tasks submitted but not finished
+    std::atomic<bool> stop_{false};
+    std::mutex sleep_m_;
+    std::condition_variable wake_;
+};
@@ -0,0 +1,52 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <stdexcept>
+
+namespace trace {
+
+std::atomic<bool> g_on{false};
+
+namespace {
+
+std::mutex g_m;
+std::FILE* g_file = nullptr;
+const auto g_t0 = std::chrono::steady_clock::now();
+std::atomic<unsigned> g_next_thread{0};
+
+unsigned thread_no(){
+    thread_local unsigned no = g_next_thread++;
+    return no;
+}
+
+} // namespace
+
+void open(const std::string& path){
+    std::lock_guard<std::mutex> lk(g_m);
+    if (g_file) return;
+    g_file = std::fopen(path.c_str(), "w");
+    if (!g_file) throw std::runtime_error("cannot open trace file " + path);
+    std::setvbuf(g_file, nullptr, _IOFBF, 1 << 20);
+    std::atexit(close);
+    g_on = true;
+}
+
+void emit(const char* category, const std::string& message){
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - g_t0).count();
+    unsigned t = thread_no();
+    std::lock_guard<std::mutex> lk(g_m);
+    if (!g_file) return;
+    std::fprintf(g_file, "%10.3f t%u %s: %s\n", ms, t, category, message.c_str());
+}
+
+void close(){
+    std::lock_guard<std::mutex> lk(g_m);
+    g_on = false;
+    if (g_file){ std::fclose(g_file); g_file = nullptr; }
+}
+
+} // namespace trace
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <string>
+
+// Debug tracing. TRACE() compiles to nothing unless the build is configured
+// with -DGREP_TRACE=ON; even then nothing is written until --trace FILE turns
+// it on. Records go to that file through a large buffer, one per line:
+//
+//   <ms since start> t<thread> <category>: <message>
+//
+//   TRACE("dfa", "cache flushed at " << n << " states");
+namespace trace {
+
+extern std::atomic<bool> g_on;
+
+inline bool enabled(){ return g_on.load(std::memory_order_relaxed); }
+
+// start writing records to `path`; throws std::runtime_error if it can't
+void open(const std::string& path);
+void emit(const char* category, const std::string& message);
+// flush and stop; also done at exit
+void close();
+
+} // namespace trace
+
+#ifdef GREP_TRACE
+#include <sstream>
+
+#define TRACE(category, expr) do { \
+        if (trace::enabled()){ \
+            std::ostringstream trace_os_; \
+            trace_os_ << expr; \
+            trace::emit(category, trace_os_.str()); \
+        } \
+    } while (0)
+#else
+#define TRACE(category, expr) do {} while (0)
+#endif
@@ -0,0 +1,258 @@
+#include "walk.hpp"
+#include "diag.hpp"
+
+#include <cerrno>
+#include <system_error>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr size_t kDentsBuffer = 64 << 10;
+
+// One line of a .gitignore / .ignore file.
+struct Walker::Rule {
+    std::string glob;
+    bool negate = false;    // "!glob": matching paths are searched after all
+    bool dir_only = false;  // "glob/": only matches directories
+    bool anchored = false;  // has a '/': matched against the path below the
+                            // directory of the file, not the base name
+};
+
+struct Walker::Dir {
+    std::string path;        // as printed: the root joined with the names below it
+    std::string name;        // last component, opened relative to the parent
+    std::string rel;         // path below the root, "" for the root itself
+    DirPtr parent;
+    dev_t dev = 0;           // set once opened
+    ino_t ino = 0;
+    std::vector<Rule> rules; // from its .gitignore and .ignore, in file order
+};
+
+static std::string join(const std::string& dir, std::string_view name){
+    std::string out = dir;
+    if (!out.empty() && out.back() != '/') out += '/';
+    out += name;
+    return out;
+}
+
+// [...] at glob[i] against c: 1 if c is in the class, 0 if not, -1 if there
+// is no closing ']' and the '[' is just a character. `end` is set past it.
+static int match_class(std::string_view g, size_t i, char c, size_t& end){
+    size_t j = i + 1;
+    bool negate = j < g.size() && (g[j] == '!' || g[j] == '^');
+    if (negate) ++j;
+    const size_t first = j;
+    const unsigned char u = c;
+    bool hit = false;
+    for (; j < g.size() && (g[j] != ']' || j == first); ++j){
+        unsigned char lo = g[j];
+        if (lo == '\\' && j + 1 < g.size()) lo = g[++j];
+        if (j + 2 < g.size() && g[j + 1] == '-' && g[j + 2] != ']'){
+            j += 2;
+            unsigned char hi = g[j];
+            if (hi == '\\' && j + 1 < g.size()) hi = g[++j];
+            hit |= lo <= u && u <= hi;
+        } else {
+            hit |= lo == u;
+        }
+    }
+    if (j >= g.size()) return -1;
+    end = j + 1;
+    return hit != negate && c != '/';
+}
+
+bool glob_match(std::string_view g, std::string_view s){
+    constexpr size_t npos = std::string_view::npos;
+    size_t gi = 0, si = 0;
+    size_t star_g = npos, star_s = 0; // the last '*', to let it take more
+    while (gi < g.size() || si < s.size()){
+        if (gi < g.size()){
+            char c = g[gi];
+            if (c == '*' && gi + 1 < g.size() && g[gi + 1] == '*'){
+                std::string_view rest = g.substr(gi + 2);
+                if (!rest.empty() && rest[0] == '/'){
+                    // "**/": nothing, or whole directories
+                    rest.remove_prefix(1);
+                    for (size_t k = si;; ){
+                        if (glob_match(rest, s.substr(k))) return true;
+                        k = s.find('/', k);
+                        if (k == npos) break;
+                        ++k;
+                    }
+                } else {
+                    for (size_t k = si; k <= s.size(); ++k){
+                        if (glob_match(rest, s.substr(k))) return true;
+                    }
+                }
+            } else if (c == '*'){
+                star_g = gi++;
+                star_s = si;
+                continue;
+            } else if (si < s.size()){
+                size_t next = gi + 1;
+                bool ok;
+                if (c == '?') ok = s[si] != '/';
+                else if (c == '['){
+                    int r = match_class(g, gi, s[si], next);
+                    ok = r < 0 ? s[si] == '[' : r == 1;
+                }
+                else if (c == '\\' && gi + 1 < g.size()){ ok = s[si] == g[gi + 1]; next = gi + 2; }
+                else ok = s[si] == c;
+                if (ok){ gi = next; ++si; continue; }
+            }
+        }
+        // mismatch: the last '*' takes one more character, never a '/'
+        if (star_g != npos && star_s < s.size() && s[star_s] != '/'){
+            gi = star_g + 1;
+            si = ++star_s;
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+Walker::Walker(const Options& opt)
+    : follow_links_(opt.dereference), use_ignore_files_(!opt.no_ignore),
+      include_(opt.include), exclude_(opt.exclude), exclude_dir_(opt.exclude_dir) {}
+
+Walker::~Walker() = default;
+
+Walker::DirPtr Walker::root(const std::string& path) const {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return nullptr;
+    auto dir = std::make_shared<Dir>();
+    dir->path = path;
+    dir->name = path;
+    return dir;
+}
+
+// The rules of dir's .gitignore then .ignore, parsed as git does: blank
+// lines and '#' comments are skipped, trailing spaces dropped unless quoted.
+void Walker::load_rules(Dir& dir, int fd) const {
+    for (const char* file : {".gitignore", ".ignore"}){
+        int f = ::openat(fd, file, O_RDONLY | O_CLOEXEC);
+        if (f < 0) continue;
+        std::string text;
+        char chunk[4096];
+        ssize_t n;
+        while ((n = ::read(f, chunk, sizeof chunk)) > 0) text.append(chunk, n);
+        ::close(f);
+
+        size_t start = 0;
+        while (start < text.size()){
+            size_t nl = text.find('\n', start);
+            if (nl == std::string::npos) nl = text.size();
+            std::string_view line(text.data() + start, nl - start);
+            start = nl + 1;
+
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            while (!line.empty() && line.back() == ' ' &&
+                   !(line.size() > 1 && line[line.size() - 2] == '\\')) line.remove_suffix(1);
+            if (line.empty() || line[0] == '#') continue;
+            Rule r;
+            if (line[0] == '!'){ r.negate = true; line.remove_prefix(1); }
+            if (!line.empty() && line.back() == '/'){ r.dir_only = true; line.remove_suffix(1); }
+            r.anchored = line.find('/') != std::string_view::npos;
+            if (!line.empty() && line[0] == '/') line.remove_prefix(1);
+            if (line.empty()) continue;
+            r.glob = line;
+            dir.rules.push_back(std::move(r));
+        }
+    }
+}
+
+bool Walker::ignored(const Dir& dir, std::string_view name, bool is_dir) const {
+    auto any = [&](const std::vector<std::string>& globs){
+        for (const auto& g : globs){
+            if (glob_match(g, name)) return true;
+        }
+        return false;
+    };
+    if (is_dir ? any(exclude_dir_) : any(exclude_) || (!include_.empty() && !any(include_))){
+        return true;
+    }
+    if (!use_ignore_files_) return false;
+    if (is_dir && name == ".git") return true;
+
+    // the last rule to match decides, starting with the nearest directory's
+    std::string rel;
+    for (const Dir* d = &dir; d; d = d->parent.get()){
+        if (d->rules.empty()) continue;
+        if (rel.empty()) rel = dir.rel.empty() ? std::string(name) : join(dir.rel, name);
+        std::string_view below = rel;
+        below.remove_prefix(d->rel.empty() ? 0 : d->rel.size() + 1);
+        for (auto r = d->rules.rbegin(); r != d->rules.rend(); ++r){
+            if (r->dir_only && !is_dir) continue;
+            if (glob_match(r->glob, r->anchored ? below : name)) return !r->negate;
+        }
+    }
+    return false;
+}
+
+Walker::DirFd::~DirFd(){
+    ::close(fd_);
+}
+
+const char* Walker::base_name(const std::string& path){
+    size_t slash = path.rfind('/');
+    return path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+void Walker::list(const DirPtr& dir, const DirFdPtr& at, const FileFn& on_file, const DirFn& on_dir) const {
+    int fd = at ? ::openat(at->fd(), dir->name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+                : ::open(dir->path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0){
+        report(dir->path, std::system_category().message(errno));
+        return;
+    }
+    auto self = std::make_shared<const DirFd>(fd); // closes it after the last user
+    struct stat st;
+    if (::fstat(fd, &st) == 0){
+        dir->dev = st.st_dev;
+        dir->ino = st.st_ino;
+        for (const Dir* up = dir->parent.get(); up; up = up->parent.get()){
+            if (up->dev == st.st_dev && up->ino == st.st_ino){
+                report(dir->path, "recursive directory loop");
+                return;
+            }
+        }
+    }
+    if (use_ignore_files_) load_rules(*dir, fd);
+
+    std::unique_ptr<char[]> buf(new char[kDentsBuffer]);
+    for (;;){
+        ssize_t n = ::getdents64(fd, buf.get(), kDentsBuffer);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) report(dir->path, std::system_category().message(errno));
+        if (n <= 0) break;
+        for (ssize_t off = 0; off < n; ){
+            const auto* d = reinterpret_cast<const struct dirent64*>(buf.get() + off);
+            off += d->d_reclen;
+            std::string_view name = d->d_name;
+            if (name == "." || name == "..") continue;
+
+            unsigned char type = d->d_type;
+            if (type == DT_UNKNOWN || (type == DT_LNK && follow_links_)){
+                // the file system didn't say, or -R wants the link's target
+                struct stat es;
+                int flags = follow_links_ ? 0 : AT_SYMLINK_NOFOLLOW;
+                if (::fstatat(fd, d->d_name, &es, flags) != 0) continue; // gone, or a dangling link
+                type = S_ISDIR(es.st_mode) ? DT_DIR : S_ISREG(es.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_DIR){
+                if (ignored(*dir, name, true)) continue;
+                auto child = std::make_shared<Dir>();
+                child->path = join(dir->path, name);
+                child->name = name;
+                child->rel = dir->rel.empty() ? std::string(name) : join(dir->rel, name);
+                child->parent = dir;
+                on_dir(child, self);
+            } else if (type == DT_REG){
+                if (!ignored(*dir, name, false)) on_file(join(dir->path, name), self);
+            }
+        }
+    }
+}
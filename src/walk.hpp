@@ -0,0 +1,83 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "options.hpp"
+
+// Directory traversal for -r / -R. Directories are read with getdents64() in
+// large batches and entries are opened and stat'ed relative to their
+// directory's descriptor, so no path is resolved from the root twice and a
+// directory renamed during the walk doesn't send it elsewhere. Each
+// directory stays open while files or subdirectories found in it wait to
+// be opened; with many of them queued that is many descriptors.
+//
+// What is searched:
+//   - regular files, and with -R whatever a symlink points to; other
+//     symlinks, devices, FIFOs and sockets are skipped
+//   - unless --no-ignore, not what the .gitignore and .ignore files of the
+//     directories walked exclude (.ignore wins over .gitignore, a deeper
+//     file over its parents), and never a .git directory
+//   - --include / --exclude / --exclude-dir filter on base names with globs
+//
+// A directory that is already being walked further up (a symlink loop, or a
+// bind mount) is reported and not entered again. Directories and files that
+// can't be read are reported on stderr and the walk goes on.
+class Walker {
+public:
+    struct Dir;
+    using DirPtr = std::shared_ptr<Dir>;
+
+    // A directory list() opened, kept open for as long as anything found
+    // in it still has to be opened relative to it.
+    class DirFd {
+    public:
+        explicit DirFd(int fd) : fd_(fd) {}
+        ~DirFd();
+        DirFd(const DirFd&) = delete;
+        DirFd& operator=(const DirFd&) = delete;
+        int fd() const { return fd_; }
+    private:
+        int fd_;
+    };
+    using DirFdPtr = std::shared_ptr<const DirFd>;
+
+    // `path` is the file as printed; `at` is its directory, to open it by
+    // base_name(path) with openat()
+    using FileFn = std::function<void(std::string path, const DirFdPtr& at)>;
+    // `at` is the parent, for list() to open `dir` in
+    using DirFn = std::function<void(const DirPtr& dir, const DirFdPtr& at)>;
+
+    explicit Walker(const Options& opt);
+    ~Walker();
+
+    // a directory given on the command line, or nullptr if `path` isn't one
+    DirPtr root(const std::string& path) const;
+
+    // Read one directory: every file to search goes to on_file and every
+    // subdirectory to walk into to on_dir, in the order the directory lists
+    // them. Pass the `at` handed to on_dir, or nullptr for a root: the
+    // directory is then opened by its full path.
+    void list(const DirPtr& dir, const DirFdPtr& at, const FileFn& on_file, const DirFn& on_dir) const;
+
+    // the last component of a path on_file was given
+    static const char* base_name(const std::string& path);
+
+private:
+    struct Rule;
+    bool ignored(const Dir& dir, std::string_view name, bool is_dir) const;
+    void load_rules(Dir& dir, int fd) const;
+
+    bool follow_links_;
+    bool use_ignore_files_;
+    std::vector<std::string> include_, exclude_, exclude_dir_;
+};
+
+// Shell-style match of `text` against `glob`: '*' and '?' don't match a '/',
+// '**' matches across directories ("**/" also matches nothing), [a-z] and
+// [!a-z] are classes and a backslash quotes the next character.
+bool glob_match(std::string_view glob, std::string_view text);
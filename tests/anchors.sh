@@ -0,0 +1,66 @@
+#!/bin/sh
+# Anchored patterns are tried at the start of the line only, and others
+# only where their first byte can start a match. -o has to respect this
+# after the first match too: ^ never matches again further along a line.
+#
+#   tests/anchors.sh path/to/exe
+exe=$1
+status=0
+
+input='apple pie
+banana
+grape
+ apple
+x1y2
+under_score
+a.c
+abc'
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'apple pie' -E '^apple'
+check ' apple' -E '^ '
+check 'apple pie' -E 'pie$'
+check 'grape' -E '^grape$'
+check 'grape' -E '^.{5}$'
+check 'apple pie
+grape
+a.c
+abc' -E '^(a|g)'
+check 'apple pie
+banana
+grape
+ apple
+under_score' -E 'e$|^b'
+
+# first bytes from classes, alternations and optional atoms
+check 'a.c
+abc' -E 'a.c'
+check 'x1y2' -E 'x\dy'
+check 'under_score' -E '\w+_'
+check 'banana
+grape' -E '[bg]r?a'
+check 'x1y2
+under_score
+a.c' -E '[^a-z ]'
+check '3' -c -E '(pie|ban|ape)'
+
+input=aaa
+check 'a' -o '^a'
+check 'a
+a' -o -E '^a|a$'
+input=abcabc
+check '0:abc
+3:abc' -o -b -E 'abc$|^abc'
+check '0:abc' -o -b -E '^abc'
+
+exit $status
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Backreferences, which only the backtracker runs: nested and repeated
+# groups, a group that has to give bytes back for \1 to match, and a
+# pattern whose plain backtracking is exponential on a line that fails.
+#
+#   tests/backrefs.sh path/to/exe
+exe=$1
+status=0
+
+input='abab
+abba
+cat cat
+cat dog
+aaaa
+xyzxyz'
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'abab' -E '(ab)\1'
+check 'abba' -E '^(a)(b)\2\1$'
+check 'cat cat' -E '(\w+) \1'
+check 'aaaa' -E '^(a+)\1$'
+check 'xyzxyz' -E '(x(y)z)\1'
+check 'abab
+aaaa
+xyzxyz' -E '^(\w+)\1$'
+check 'abba
+aaaa' -E '(a|b)\1'
+check 'bb
+aa
+aa' -o -E '(\w)\1'
+check 'cat cat
+cat dog' -e '(\w+) \1' -e dog
+
+input=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaac
+check '' -E '^(a+)+\1b'
+
+exit $status
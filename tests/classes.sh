@@ -0,0 +1,62 @@
+#!/bin/sh
+# Bracket expressions and the \d and \w shorthands, inside and outside a
+# class: ranges, negation, a literal '-' or '^', and bytes outside ASCII,
+# which only a negated class matches.
+#
+#   tests/classes.sh path/to/exe
+exe=$1
+status=0
+
+input='abc
+ABC
+123
+a-b
+x]y
+tab	here
+é
+_under
+a^b'
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'abc' -E '[a-c]{3}'
+check 'ABC' -E '[A-Z]'
+check 'ABC
+a-b
+x]y
+tab	here
+é
+_under
+a^b' -E '[^a-z0-9]'
+check 'abc
+a-b
+tab	here' -E '[a\-]b'
+check 'abc
+a-b
+tab	here
+a^b' -E '[-a]'
+check 'a^b' -E '[a^]\^'
+check '123' -E '\d{3}'
+check '123' -E '[\d]'
+check 'abc
+ABC
+123
+_under' -E '^\w+$'
+check 'a-b
+x]y
+tab	here
+é
+a^b' -E '[^\w]'
+check 'x]y' -E 'x]'
+check '2' -c -E '[	^]'
+
+exit $status
@@ -0,0 +1,66 @@
+#!/bin/sh
+# -A, -B and -C: context around each match, groups that touch or overlap
+# merged into one, and "--" between groups that don't.
+#
+#   tests/context.sh path/to/exe
+exe=$1
+status=0
+
+input=$(seq 1 12)
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:\n%s\n  want:\n%s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check '5
+6' -A1 5
+check '3
+4
+5' -B2 5
+check '4
+5
+6' -C1 5
+
+# overlapping, touching and separate groups
+check '2
+3
+4
+5
+6' -C1 -e 3 -e 5
+check '2
+3
+4
+5
+6
+7' -C1 -e 3 -e 6
+check '2
+3
+4
+--
+6
+7
+8' -C1 -e 3 -e 7
+check '5
+6
+7' -A1 -e 5 -e 6
+
+# context cut off at either end of the input
+check '1
+2
+--
+12' -A1 -e '^1$' -e 12
+check '1' -B3 '^1$'
+
+# -m stops before the trailing context of later matches; -c and -o print none
+check '1' -B1 -m1 1
+check '1' -c -C2 5
+check '5' -C1 -o 5
+
+exit $status
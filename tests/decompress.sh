@@ -0,0 +1,37 @@
+#!/bin/sh
+# -z over several MiB of repeated text: it compresses so well that one read
+# of compressed input decodes to more than a whole block, and every line has
+# to come out anyway. Formats without a compressor on PATH or without their
+# library in this build are skipped.
+#
+#   tests/decompress.sh path/to/exe
+exe=$1
+status=0
+ran=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+lines=400000
+yes 'the same line of text, over and over' | head -n $lines > "$dir/rep.txt"
+
+# check FORMAT COMPRESSOR...: search the file the compressor makes
+check(){
+    format=$1
+    shift
+    command -v "$1" > /dev/null || return 0
+    "$@" < "$dir/rep.txt" > "$dir/rep.$format" || return 0
+    got=$("$exe" -z -c 'of text' "$dir/rep.$format" 2> "$dir/err")
+    if grep -q 'not supported' "$dir/err"; then return 0; fi
+    ran=1
+    if [ "$got" != $lines ] || [ -s "$dir/err" ]; then
+        printf 'FAIL: %s: %s lines, want %s\n' "$format" "$got" $lines
+        cat "$dir/err"
+        status=1
+    fi
+}
+
+check gz gzip -9 -c
+check zst zstd -19 -q -c
+
+[ $ran = 1 ] || exit 77
+exit $status
@@ -0,0 +1,41 @@
+#!/bin/sh
+# -z on a pipe that goes quiet after a match: -q and -m1 have their answer
+# as soon as the compressed line comes in, and must not wait for the writer
+# to finish (or hang joining the decoder). Skipped without gzip on PATH or
+# zlib in this build.
+#
+#   tests/decompress_pipe.sh path/to/exe
+exe=$1
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+command -v gzip > /dev/null || exit 77
+printf 'one\ntwo match\nthree\n' | gzip -c > "$dir/in.gz"
+"$exe" -z -q match "$dir/in.gz" 2> /dev/null || exit 77
+
+# check WANT ARGS...: the output of exe ARGS on a pipe held open for 5s,
+# which must end within 2s
+check(){
+    want=$1
+    shift
+    rm -f "$dir/fifo"
+    mkfifo "$dir/fifo"
+    (cat "$dir/in.gz"; exec sleep 5) > "$dir/fifo" &
+    writer=$!
+    start=$(date +%s)
+    got=$("$exe" "$@" < "$dir/fifo")
+    took=$(( $(date +%s) - start ))
+    kill $writer 2> /dev/null
+    wait $writer 2> /dev/null
+    if [ "$got" != "$want" ] || [ $took -gt 2 ]; then
+        printf 'FAIL: %s: got [%s] after %ss, want [%s]\n' "$*" "$got" $took "$want"
+        status=1
+    fi
+}
+
+check '' -z -q match
+check 'two match' -z -m1 match
+check '1' -z -c -m1 match
+
+exit $status
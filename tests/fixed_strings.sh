@@ -0,0 +1,44 @@
+#!/bin/sh
+# A lone -F pattern, or an -E one made only of escaped characters, is
+# compiled as a regex again; its metacharacters must still match themselves.
+#
+#   tests/fixed_strings.sh path/to/exe
+exe=$1
+status=0
+
+input='a
+aa
+a*
+a{2}
+a+
+a?
+(a)
+a|b
+b'
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'a*' -F 'a*'
+check 'a{2}' -F 'a{2}'
+check 'a+' -F 'a+'
+check 'a?' -F 'a?'
+check '(a)' -F '(a)'
+check 'a|b' -F 'a|b'
+
+check 'a*' -E 'a\*'
+check 'a{2}' -E 'a\{2\}'
+check 'a+' -E 'a\+'
+check 'a?' -E 'a\?'
+check '(a)' -E '\(a\)'
+check 'a|b' -E 'a\|b'
+
+exit $status
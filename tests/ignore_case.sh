@@ -0,0 +1,52 @@
+#!/bin/sh
+# -i over literals, classes, ranges, negated classes, backreferences and
+# several patterns at once. -o prints the line's own bytes, not the case
+# the pattern was written in.
+#
+#   tests/ignore_case.sh path/to/exe
+exe=$1
+status=0
+
+input='Hello World
+HELLO
+hello
+hELLo there
+ABC123
+[x]'
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'Hello World
+HELLO
+hello
+hELLo there' -i hello
+check '4' -i -c HELLO
+check '' hELLO
+check 'Hello
+HELLO
+hello
+hELLo' -i -o -E 'h[a-z]+o'
+check 'ABC123' -i -E '^abc[0-9]+$'
+check 'ABC123' -i -E '^[a-c]+1'
+check 'ABC123
+[x]' -i -E '[^a-z ]+$'
+check '[x]' -i -F '[X]'
+check 'Hello World
+ABC123' -i -e WORLD -e abc
+check 'll
+LL
+ll
+LL' -i -o LL
+check 'HELLO
+hello' -i -E '^h(E)(l)\2o$'
+
+exit $status
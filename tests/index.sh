@@ -0,0 +1,72 @@
+#!/bin/sh
+# --index DIR prints what -r over DIR prints: the files the index rules
+# out count as searched, the index file and binary files don't show up.
+# Both are checked against each other and against fixed output.
+#
+#   tests/index.sh path/to/exe
+exe=$1
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+mkdir -p "$dir/t/sub"
+printf 'alpha beta\ngamma\n' > "$dir/t/a.txt"
+printf 'nothing here\n' > "$dir/t/b.txt"
+printf 'beta\nbeta again\n' > "$dir/t/sub/c.txt"
+printf 'beta\0binary\n' > "$dir/t/sub/d.bin"
+"$exe" --index-build "$dir/t" 2> /dev/null || { echo "FAIL: --index-build"; exit 1; }
+
+# same ARGS...: -r and --index agree on ARGS
+same(){
+    want=$("$exe" -r "$@" "$dir/t")
+    got=$("$exe" --index "$dir/t" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: --index %s\n  got:\n%s\n  want (-r):\n%s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+# check WANT ARGS...: --index ARGS prints exactly WANT, sorted, with paths
+# below the tree
+check(){
+    want=$1
+    shift
+    got=$("$exe" --index "$dir/t" "$@" | sed "s|^$dir/||" | LC_ALL=C sort)
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: --index %s\n  got:\n%s\n  want:\n%s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+same -c beta
+same -c gamma
+same -c zzz
+same -l beta
+same beta
+same -c -i BETA
+
+check 't/a.txt:1
+t/b.txt:0
+t/sub/c.txt:2' -c beta
+check 't/a.txt:0
+t/b.txt:0
+t/sub/c.txt:0' -c zzz
+check 't/a.txt
+t/sub/c.txt' -l beta
+check 't/a.txt:alpha beta
+t/sub/c.txt:beta
+t/sub/c.txt:beta again' beta
+# -a searches binary files, but never the index (which -r -a would)
+check 't/a.txt:1
+t/b.txt:0
+t/sub/c.txt:2
+t/sub/d.bin:1' -a -c beta
+
+# a file changed since the build is searched again
+printf 'zzz\n' >> "$dir/t/b.txt"
+same -c zzz
+check 't/a.txt:0
+t/b.txt:1
+t/sub/c.txt:0' -c zzz
+
+exit $status
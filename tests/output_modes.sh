@@ -0,0 +1,56 @@
+#!/bin/sh
+# -c, -l, -q and -m: what they print and the exit status, which is 0 when
+# something matched, over stdin and over several files.
+#
+#   tests/output_modes.sh path/to/exe
+exe=$(cd "$(dirname "$1")" && pwd)/$(basename "$1") # run from $dir
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+input='apple pie
+banana
+apple tart
+cherry'
+printf '%s\n' "$input" > "$dir/a.txt"
+printf 'kiwi\n' > "$dir/b.txt"
+cd "$dir" || exit 1
+
+# check WANT CODE ARGS...: exe ARGS over $input prints exactly WANT and
+# exits with CODE
+check(){
+    want=$1
+    code=$2
+    shift 2
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    rc=$?
+    if [ "$got" != "$want" ] || [ $rc != "$code" ]; then
+        printf 'FAIL: exe %s\n  got:  %s (%s)\n  want: %s (%s)\n' "$*" "$got" $rc "$want" "$code"
+        status=1
+    fi
+}
+
+check '2' 0 -c apple
+check '0' 1 -c zzz
+check '1' 0 -c -m1 apple
+check 'a.txt:2
+b.txt:0' 0 -c apple a.txt b.txt
+check 'a.txt:1
+b.txt:0' 0 -c -m1 apple a.txt b.txt
+
+check 'a.txt' 0 -l apple b.txt a.txt
+check '' 1 -l zzz a.txt b.txt
+check 'a.txt
+b.txt' 0 -l -e apple -e kiwi a.txt b.txt
+
+check '' 0 -q apple
+check '' 1 -q zzz
+check '' 0 -q apple a.txt b.txt
+
+check 'apple pie' 0 -m1 apple
+check 'apple pie
+apple tart' 0 -m2 apple
+check '' 1 -m0 apple
+check 'a.txt:apple pie' 0 -m1 apple a.txt b.txt
+
+exit $status
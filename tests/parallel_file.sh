@@ -0,0 +1,46 @@
+#!/bin/sh
+# -j over one file large enough to be split into pieces: counts, -m, byte
+# offsets and -o spans come out as one thread gives them, across the
+# pieces' boundaries.
+#
+#   tests/parallel_file.sh path/to/exe
+exe=$(cd "$(dirname "$1")" && pwd)/$(basename "$1") # run from $dir
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+seq 1 3000000 > "$dir/big" # 22 MB
+cd "$dir" || exit 1
+
+# check WANT ARGS...: exe -j4 ARGS big prints exactly WANT, as -j1 does
+check(){
+    want=$1
+    shift
+    for j in 1 4; do
+        got=$("$exe" -j$j "$@" big)
+        if [ "$got" != "$want" ]; then
+            printf 'FAIL: exe -j%s %s\n  got:\n%s\n  want:\n%s\n' $j "$*" "$got" "$want"
+            status=1
+        fi
+    done
+}
+
+check '1111' -c '^1234'
+check '1141' -c -e '00000$' -e '^777'
+check '7
+17
+27
+37
+47' -m5 '7$'
+check '5' -c -m5 '7$'
+check '10888888:1500000' -b '^1500000$'
+check '22888880:2999999' -b '^2999999$'
+check '588882:99999
+1288882:99999
+1988882:99999' -o -b -m3 '99999$'
+# all 30 of them, as one thread finds them
+check "$("$exe" -j1 -o -b '99999$' big)" -o -b '99999$'
+check 'big' -l 2999999
+check '' -q 2999999
+
+exit $status
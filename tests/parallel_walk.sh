@@ -0,0 +1,59 @@
+#!/bin/sh
+# -r -j over a tree of many small files: every file is searched once, and
+# --ordered prints in the order -j1 does. Without --ordered files may come
+# out in any order, so that output is sorted.
+#
+#   tests/parallel_walk.sh path/to/exe
+exe=$(cd "$(dirname "$1")" && pwd)/$(basename "$1") # run from $dir
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+export LC_ALL=C
+
+cd "$dir" || exit 1
+for d in 1 2 3 4 5 6 7 8; do
+    mkdir -p t/d$d/e
+    for f in 1 2 3 4 5 6 7 8 9 10; do
+        printf 'd%s f%s\ncommon\n' $d $f > t/d$d/f$f
+    done
+    printf 'deep %s\n' $d > t/d$d/e/g
+done
+
+# check WANT ARGS...: exe -r -j4 ARGS t, sorted, is exactly WANT
+check(){
+    want=$1
+    shift
+    got=$("$exe" -r -j4 "$@" t | sort)
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe -r -j4 %s\n  got:\n%s\n  want:\n%s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+# ordered ARGS...: exe -r -j4 --ordered ARGS t prints what -j1 does
+ordered(){
+    want=$("$exe" -r -j1 "$@" t)
+    got=$("$exe" -r -j4 --ordered "$@" t)
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe -r -j4 --ordered %s\n  got:\n%s\n  want (-j1):\n%s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+all=$(for d in 1 2 3 4 5 6 7 8; do for f in 1 2 3 4 5 6 7 8 9 10; do
+          echo "t/d$d/f$f"; done; done)
+deep=$(for d in 1 2 3 4 5 6 7 8; do echo "t/d$d/e/g"; done)
+
+check "$(echo "$all" | sed 's/$/:common/' | sort)" common
+check "$(echo "$all" | sed 's/$/:1/' | sort)" -c -m1 . --exclude=g
+check "$deep" -l deep
+check 't/d3/e/g:deep 3
+t/d3/f7:d3 f7' -e 'd3 f7' -e 'deep 3'
+check 't/d8/f10:1' -c common --include=f10 --exclude-dir=d[1-7]
+check '' -q common
+
+ordered common
+ordered -c -e d5 -e deep
+ordered -l 'f1$'
+
+exit $status
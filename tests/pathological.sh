@@ -0,0 +1,49 @@
+#!/bin/sh
+# The pathological cases of grep-bench at a size ctest can afford: patterns
+# a naive backtracker takes exponential time on, each over runs of a's that
+# almost match. Each must give the right count within a few seconds; the
+# backreference ones give up on lines past --backtrack-limit and say so.
+#
+#   tests/pathological.sh path/to/exe
+exe=$1
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# as bench.cpp's make_pathological(): every 97th line can match
+awk 'BEGIN { for (k = 0; k < 500; k++){
+                 s = ""; for (i = 0; i < 20 + k % 12; i++) s = s "a"
+                 print s (k % 97 == 0 ? "b" : "!bc") } }' > "$dir/patho"
+# as make_run(), a third as long
+awk 'BEGIN { s = "a"; while (length(s) < 50000) s = s s; print s }' > "$dir/run"
+
+# check WANT FILE ARGS...: exe -c ARGS FILE prints WANT within 10s
+check(){
+    want=$1
+    file=$2
+    shift 2
+    start=$(date +%s)
+    got=$("$exe" -c "$@" "$dir/$file" 2> "$dir/err")
+    took=$(( $(date +%s) - start ))
+    if [ "$got" != "$want" ] || [ $took -gt 10 ]; then
+        printf 'FAIL: exe -c %s %s: got %s after %ss, want %s\n' "$*" $file "$got" $took "$want"
+        status=1
+    fi
+}
+
+check 6 patho -E '(a+)+b'
+check 0 patho -E '(a|aa)+c'
+check 0 patho -E '(a?)+a+c'
+check 0 run -E 'a.{10000}[bc]'
+
+check 0 patho --backtrack-limit=10000 -E '(a+)+\1c'
+if ! grep -q '^warning: 494 line(s) exceeded the backtracking limit' "$dir/err"; then
+    printf 'FAIL: no warning for lines past --backtrack-limit\n'
+    cat "$dir/err"
+    status=1
+fi
+check 0 patho --backtrack-limit=10000 -E '((a|aa)+)\1c'
+check 0 patho -E '(a)\1(a|aa)+c'
+check 6 patho -E '(a)\1(a|aa)+b'
+
+exit $status
@@ -0,0 +1,61 @@
+#!/bin/sh
+# -e and -f: a line matches if any pattern does, whichever engine each
+# pattern ends up in (literals, regexes, backreferences), and an empty
+# pattern matches every line.
+#
+#   tests/patterns.sh path/to/exe
+exe=$1
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+input='apple pie
+banana
+apple tart
+cherry
+a.b'
+printf 'ban\nrry\n' > "$dir/pats"
+printf 'ban\n\n' > "$dir/empty"
+: > "$dir/none"
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'banana
+cherry' -e ban -e rry
+check 'banana
+cherry' -f "$dir/pats"
+check 'banana
+apple tart
+cherry' -f "$dir/pats" -e tart
+check 'apple pie
+banana
+apple tart' -e ana -e nan -e apple
+check '1' -c -e an -e ana
+
+# literals, a regex and a backreference side by side
+check 'apple pie
+cherry' -e '^ch' -e 'pie$'
+check 'apple pie
+apple tart
+cherry' -e '(p)\1' -e rry
+check 'cherry
+a.b' -e 'a\.b' -e 'e(r)\1y' -e zzz
+check 'a.b' -F -e a.b -e zz
+
+check 'apple pie
+banana
+apple tart
+cherry
+a.b' -f "$dir/empty"
+check '' -f "$dir/none"
+
+exit $status
@@ -0,0 +1,67 @@
+#!/bin/sh
+# *, +, ?, {n}, {n,}, {,m}, {n,m} and their lazy forms. The command line
+# reports leftmost-longest spans, as grep -E does, so a lazy quantifier
+# picks the same lines and the same -o spans as a greedy one. Patterns that
+# blow up a naive backtracker have to finish too.
+#
+#   tests/quantifiers.sh path/to/exe
+exe=$1
+status=0
+
+input='a
+aa
+aaa
+aaaa
+ab
+abbb
+x{2}
+d 1234567890123'
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'aa' -E '^a{2}$'
+check 'aa
+aaa' -E '^a{2,3}$'
+check 'aa
+aaa
+aaaa' -E '^a{2,}$'
+check 'a
+aa' -E '^a{,2}$'
+check 'a
+ab' -E '^ab{0,1}$'
+check 'ab
+abbb' -E '^a{1,2}b+$'
+check 'a
+aa
+aaa
+aaaa' -E '^a*$'
+check 'x{2}' -F 'x{2}'
+check '3' -c -E 'a{3}|b{3}|a{2}c'
+
+check '2
+1234567890
+123' -o -E '[0-9]{1,10}'
+check 'aa
+aaa
+aaa' -o -E 'a{2,3}?'
+check 'ab
+abbb' -o -E '^ab+?'
+check 'ab
+abbb' -E '^a+?b*?b$'
+
+# exponential for a backtracker that tries every split
+a25=aaaaaaaaaaaaaaaaaaaaaaaaa
+input=$a25
+check "$a25" -E '^(a?){25}a{25}$'
+check '' -E '^(a|aa){1,30}b'
+
+exit $status
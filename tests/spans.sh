@@ -0,0 +1,52 @@
+#!/bin/sh
+# -o, -b and --color print the spans the engines report: every
+# non-overlapping leftmost match, its byte offset, and the line with each
+# match wrapped in GNU grep's escapes.
+#
+#   tests/spans.sh path/to/exe
+exe=$1
+status=0
+
+input='apple pie
+banana
+apple tart
+cherry'
+
+# check WANT ARGS...: exe ARGS over $input prints exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@")
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:  %s\n  want: %s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check 'an
+an' -o an
+check 'apple
+apple
+cherry' -o -E '(ap|ch)[a-z]*'
+check 'ban' -o -e ban -e nana
+check 'ple pie
+ple tart' -o 'p[a-z]e.*'
+check 'apple
+apple' -o -i APPLE
+check '' -o 'x*'
+
+check '0:apple pie
+17:apple tart' -b apple
+check '11:an
+13:an' -o -b an
+
+esc=$(printf '\033')
+on="$esc[01;31m$esc[K"
+off="$esc[m$esc[K"
+check "b${on}an${off}${on}an${off}a" --color=always an
+check "${on}an${off}
+${on}an${off}" --color=always -o an
+check 'banana' --color=never an
+check '1' --color=always -c an
+
+exit $status
@@ -0,0 +1,38 @@
+#!/bin/sh
+# --stats on stderr, as text and as JSON: the engine and prefilter each
+# pattern got and the totals that don't depend on timing. Engine work and
+# times vary, so they are cut out before comparing.
+#
+#   tests/stats.sh path/to/exe
+exe=$1
+status=0
+
+input='apple
+banana
+pear tree'
+
+# check WANT ARGS...: what exe ARGS over $input prints on stderr, less
+# timing and engine work, is exactly WANT
+check(){
+    want=$1
+    shift
+    got=$(printf '%s\n' "$input" | "$exe" "$@" 2>&1 > /dev/null |
+          sed -e 's/,"engine":{[^}]*},"seconds":{[^}]*}//' -e '/^  engine work:/d' -e '/^  time:/d')
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe %s\n  got:\n%s\n  want:\n%s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check '{"patterns":[{"pattern":"tree$","engine":"dfa","prefilter":"tree"}],"inputs":1,"bytes":23,"lines":3,"prefilter":{"lines_skipped":2,"candidates":1,"rejected":0,"hit_rate":1.000}}' \
+    --stats=json 'tree$'
+check '{"patterns":[{"pattern":"apple","engine":"aho-corasick","prefilter":null},{"pattern":"pear","engine":"aho-corasick","prefilter":null},{"pattern":"b(a)n","engine":"dfa","prefilter":"ban"},{"pattern":"(a)\\1","engine":"backtrack","prefilter":null}],"inputs":1,"bytes":23,"lines":3,"prefilter":{"lines_skipped":2,"candidates":1,"rejected":0,"hit_rate":1.000}}' \
+    --stats=json -e apple -e pear -e 'b(a)n' -e '(a)\1'
+check 'stats:
+  dfa: 1 pattern (#1), prefilter "tree"
+  read: 1 inputs, 23 bytes, 3 lines
+  prefilter: 2 lines skipped, 1 candidates, 0 rejected (100.0% matched)' \
+    --stats 'tree$'
+check '' 'tree$'
+
+exit $status
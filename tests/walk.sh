@@ -0,0 +1,61 @@
+#!/bin/sh
+# What -r searches: .gitignore and .ignore rules (negation, directory-only
+# and anchored patterns, a deeper file's rules, .ignore over .gitignore),
+# --no-ignore, --include / --exclude / --exclude-dir, and binary files
+# skipped unless -a. The walk's order isn't fixed, so output is sorted.
+#
+#   tests/walk.sh path/to/exe
+exe=$(cd "$(dirname "$1")" && pwd)/$(basename "$1") # run from $dir
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cd "$dir" || exit 1
+mkdir -p .git build keep logs src/gen sub
+for f in a.txt b.log c.md .git/config build/x.txt keep/k.log logs/l.txt \
+         src/main.c src/gen/out.c sub/c.md; do
+    printf 'hit\n' > "$f"
+done
+printf 'hit\0binary\n' > data.bin
+printf '*.log\nbuild/\n!keep/k.log\n/c.md\n' > .gitignore
+printf '!b.log\n' > .ignore
+printf 'gen\n' > src/.gitignore
+
+# check WANT ARGS...: exe -r ARGS over the tree prints exactly WANT, sorted
+check(){
+    want=$1
+    shift
+    got=$("$exe" -r "$@" . | sort)
+    if [ "$got" != "$want" ]; then
+        printf 'FAIL: exe -r %s\n  got:\n%s\n  want:\n%s\n' "$*" "$got" "$want"
+        status=1
+    fi
+}
+
+check './a.txt:hit
+./b.log:hit
+./keep/k.log:hit
+./logs/l.txt:hit
+./src/main.c:hit
+./sub/c.md:hit' hit
+check './.git/config:hit
+./a.txt:hit
+./b.log:hit
+./build/x.txt:hit
+./c.md:hit
+./keep/k.log:hit
+./logs/l.txt:hit
+./src/gen/out.c:hit
+./src/main.c:hit
+./sub/c.md:hit' --no-ignore hit
+
+check './src/main.c:hit' --include='*.c' hit
+check './b.log:hit
+./keep/k.log:hit
+./sub/c.md:hit' --exclude='*.txt' --exclude-dir=src hit
+
+check './a.txt' -l --include='*.txt' --exclude-dir=logs hit
+check './data.bin:1' -a -c --include='*.bin' hit
+check '' --include='*.bin' hit
+
+exit $status